@@ -1,17 +1,20 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwrite_start and later bwait to write several at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading blocks that will be wanted soon,
+//     call breadahead for each, then bunplug.
 
 
 #include "types.h"
@@ -23,11 +26,31 @@
 #include "fs.h"
 #include "buf.h"
 
+// Buffers are found through a hash table on (dev, blockno),
+// each of whose buckets has its own lock, so lookups of
+// different blocks don't contend. A buffer's refcnt is
+// protected by the lock of its bucket. The buffers nobody
+// holds are also on an LRU list, protected by bcache.lock,
+// from which bget() takes one to recycle on a miss; misses
+// are serialized by bcache.evictlock, so that the same block
+// is never given two buffers, and so that an evicting bget()
+// may take a second bucket lock without deadlock. Lock order
+// is evictlock, then bucket locks, then bcache.lock.
+#define NBUCKET 127
+#define BHASH(dev, blockno) ((((uint64)(dev) << 32) | (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;
+};
+
 struct {
   struct spinlock lock;
+  struct spinlock evictlock;
   struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
 
-  // Linked list of all buffers, through prev/next.
+  // Linked list of unused buffers, through prev/next.
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
@@ -37,10 +60,15 @@ void
 binit(void)
 {
   struct buf *b;
+  struct bucket *h;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&bcache.evictlock, "bcache_evict");
+  for(h = bcache.bucket; h < bcache.bucket+NBUCKET; h++)
+    initlock(&h->lock, "bcache_bucket");
 
-  // Create linked list of buffers
+  // Create linked list of buffers. Each starts out as an
+  // invalid copy of block b-bcache.buf of device 0.
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
@@ -49,7 +77,72 @@ binit(void)
     initsleeplock(&b->lock, "buffer");
     bcache.head.next->prev = b;
     bcache.head.next = b;
+    b->dev = 0;
+    b->blockno = b - bcache.buf;
+    h = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    b->hnext = h->head;
+    h->head = b;
+  }
+}
+
+// Look for the block in bucket h, whose lock must be held,
+// and take a reference to it if it is there.
+static struct buf*
+bfind(struct bucket *h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = h->head; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      if(b->refcnt++ == 0){
+        acquire(&bcache.lock);
+        b->next->prev = b->prev;
+        b->prev->next = b->next;
+        release(&bcache.lock);
+      }
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Take the least recently used unused buffer off the LRU
+// list and out of its bucket, for bget() to recycle. Caller
+// holds bcache.evictlock and h->lock.
+static struct buf*
+bevict(struct bucket *h)
+{
+  struct buf *b, **pp;
+  struct bucket *h2;
+
+  for(;;){
+    acquire(&bcache.lock);
+    b = bcache.head.prev;
+    release(&bcache.lock);
+    if(b == &bcache.head)
+      panic("bget: no buffers");
+
+    // only an evicting bget() changes b's identity, so h2
+    // stays its bucket, but b may have been taken since.
+    h2 = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    if(h2 != h)
+      acquire(&h2->lock);
+    if(b->refcnt == 0)
+      break;
+    if(h2 != h)
+      release(&h2->lock);
   }
+
+  acquire(&bcache.lock);
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  release(&bcache.lock);
+  for(pp = &h2->head; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+  if(h2 != h)
+    release(&h2->lock);
+  return b;
 }
 
 // Look through buffer cache for block on device dev.
@@ -59,33 +152,55 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
+  struct bucket *h = &bcache.bucket[BHASH(dev, blockno)];
 
-  acquire(&bcache.lock);
+  acquire(&h->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = bfind(h, dev, blockno)) != 0){
+    release(&h->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&h->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached. Look again once no other miss can be
+  // loading it, then recycle the least recently used
+  // unused buffer.
+  acquire(&bcache.evictlock);
+  acquire(&h->lock);
+  if((b = bfind(h, dev, blockno)) == 0){
+    b = bevict(h);
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    b->refcnt = 1;
+    b->hnext = h->head;
+    h->head = b;
+  }
+  release(&h->lock);
+  release(&bcache.evictlock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Drop a reference to b, putting it at the head of
+// the LRU list if it was the last one.
+static void
+bput(struct buf *b)
+{
+  struct bucket *h = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&h->lock);
+  if(--b->refcnt == 0){
+    acquire(&bcache.lock);
+    b->next = bcache.head.next;
+    b->prev = &bcache.head;
+    bcache.head.next->prev = b;
+    bcache.head.next = b;
+    release(&bcache.lock);
   }
-  panic("bget: no buffers");
+  release(&h->lock);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,6 +217,42 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Called by virtio_disk_intr() when a read started by
+// breadahead() is done.
+static void
+bdone(struct buf *b)
+{
+  b->valid = 1;
+  b->done = 0;
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Queue a read of the block into the cache, unless it is
+// there already, without waiting for it. bread() of the
+// block then waits only for the rest of the read. The read
+// may wait for more to merge with until bunplug().
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->valid){
+    brelse(b);
+    return;
+  }
+  b->done = bdone;
+  virtio_disk_submit(b, 0);
+}
+
+// Send the reads queued by breadahead() to the disk.
+void
+bunplug(void)
+{
+  virtio_disk_unplug();
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,6 +262,25 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Start writing b's contents to disk, without waiting for
+// it, so that many writes can be in flight at once. b must
+// be locked, and must not be changed or released until
+// bwait(b) returns.
+void
+bwrite_start(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_start");
+  virtio_disk_submit(b, 1);
+}
+
+// Wait for a write started by bwrite_start() to finish.
+void
+bwait(struct buf *b)
+{
+  virtio_disk_wait(b);
+}
+
 // Release a locked buffer.
 // Move to the head of the most-recently-used list.
 void
@@ -120,34 +290,19 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *h = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&h->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&h->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt--;
-  release(&bcache.lock);
+  bput(b);
 }
-
-
@@ -5,7 +5,12 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  void (*done)(struct buf*); // if set, the disk calls it when I/O ends
+  int write;         // for the I/O scheduler: a write?
+  uint deadline;     // ticks by which it should go to the disk
+  struct buf *qnext; // I/O scheduler queue, then the rest of a request
+  struct buf *hnext; // hash bucket chain
+  struct buf *prev;  // LRU list of unused buffers
   struct buf *next;
   uchar data[BSIZE];
 };
@@ -0,0 +1,8 @@
+// Per-cpu statistics, returned by the cpustat() system call.
+// Times are in cycles of the machine timer (10MHz in qemu).
+struct cpustat {
+  uint64 uptime;    // Time since the cpu started; 0 if it never did.
+  uint64 idle;      // Time spent waiting in wfi.
+  uint64 wakeups;   // Times woken from wfi.
+  uint64 ipis;      // Interrupts received from other cpus.
+};
@@ -8,14 +8,25 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct hrtimer;
+struct memstat;
+struct diskstat;
+struct kmem_cache;
+struct seg;
+struct vma;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_start(struct buf*);
+void            bwait(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            breadahead(uint, uint);
+void            bunplug(void);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +35,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+struct seg*     execseg(struct proc*, uint64);
+int             execfault(struct proc*, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -40,6 +53,10 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+int             iwriteget(struct inode*);
+void            iwriteput(struct inode*);
+int             itextget(struct inode*);
+void            itextput(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -50,6 +67,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+void            iprefetch(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -63,14 +81,36 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kmemstat(struct memstat*);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
+void            kref(void *);
+int             krefcount(void *);
+
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             slab_pages(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            log_force(void);
+
+// mmap.c
+struct vma*     vma_find(struct proc*, uint64);
+uint64          vma_base(struct proc*);
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
+int             vmafault(struct proc*, uint64);
+void            vma_unmapall(struct proc*);
+int             vma_copy(struct proc*, struct proc*);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -98,6 +138,7 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+int             kthread_create(void (*)(void), char*);
 int             wait(uint64);
 int             waitx(uint64, uint*, uint*);
 void            wakeup(void*);
@@ -105,13 +146,25 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             cpustat(uint64, int);
 int             trace(int);
 int             set_priority(int, int);
-void            update_time(void);
-void            update_q_wtime(void);
 
-void            add_into_mlfq(int, struct proc *);
-void            set_overshot_proc();
+// sched.c
+void            runq_add(struct proc*);
+void            sched_wakeup(struct proc*);
+struct proc*    sched_pick(struct cpu*);
+void            sched_put_prev(struct proc*);
+int             sched_tick(void);
+int             sched_setpolicy(int, int);
+int             sched_setnice(int, int);
+void            sched_kick(struct proc*);
+int             sched_setaffinity(int, uint64);
+uint64          sched_getaffinity(int);
+int             sched_has_work(struct cpu*);
+char*           sched_name(int);
+int             pbs_priority(struct proc*);
+extern int      sched_default;
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -153,6 +206,25 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            ipi_send(int);
+void            tick_stop(void);
+void            tick_start(void);
+void            oneshot_set(uint64);
+
+// text.c
+void            textinit(void);
+void*           text_get(struct inode*, uint, uint);
+void            text_put(struct inode*, uint, uint, void*);
+void            text_drop(struct inode*);
+int             text_pages(void);
+
+// timer.c
+void            timer_add(struct timer*, uint, void*);
+void            timer_del(struct timer*);
+void            timer_tick(void);
+void            hrtimer_add(struct hrtimer*, uint64, void*);
+void            hrtimer_del(struct hrtimer*);
+void            hrtimer_expire(void);
 
 // uart.c
 void            uartinit(void);
@@ -165,15 +237,24 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+uint64          uvmsatp(struct proc*);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, int);
+int             uvmmega(pagetable_t, uint64, uint64, uint64, int);
+int             uvmlazy(pagetable_t, uint64, uint64);
+int             uvmfault(struct proc*, uint64);
+void            uvmprefault(uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
+pte_t*          walkleaf(pagetable_t, uint64, int*);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -185,21 +266,18 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// iosched.c
+void            iosched_add(struct buf*);
+struct buf*     iosched_next(void);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_unplug(void);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
+void            virtio_disk_stat(struct diskstat*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
-
-#define MAX_QUEUE_SIZE 100
-#define NUM_OF_QUEUES 5
-#define MAX_OLD_AGE 50
-struct MLFQ_Queue
-{
-  struct proc* arr[MAX_QUEUE_SIZE];
-  int num_procs;
-};
-
-extern struct MLFQ_Queue mlfq_queue[NUM_OF_QUEUES];
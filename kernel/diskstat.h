@@ -0,0 +1,10 @@
+// Disk driver statistics, returned by the
+// diskstat() system call.
+struct diskstat {
+  uint64 nread;           // Read requests issued to the device.
+  uint64 nwrite;          // Write requests issued to the device.
+  uint64 nmerged;         // Blocks merged into another block's request.
+  uint64 nnotify;         // Times the device was notified of new requests.
+  uint64 nintr;           // Disk interrupts taken.
+  uint64 maxinflight;     // Most requests the device has had at once.
+};
@@ -7,17 +7,16 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
-
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg = 0;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct seg seg[NSEG];
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,7 +37,8 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments. Their pages are read
+  // in by execfault() when the program first touches them.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -46,17 +46,23 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz >= TRAPFRAME)
       goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg == NSEG)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
+  if(itextget(ip) < 0)
+    goto bad;  // open for writing
+  exe = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -109,12 +115,24 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  vma_unmapall(p);
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
+  p->asid = 0;  // the old ASID's TLB entries are for oldpagetable
   p->sz = sz;
+  p->exe = exe;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    itextput(oldexe);
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -125,30 +143,73 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    itextput(exe);
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// The segment of p's program that va lies in, or 0.
+struct seg*
+execseg(struct proc *p, uint64 va)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
+  struct seg *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      return s;
+  return 0;
+}
+
+// Map the page of p's program at va, the first time it is
+// touched. A page with contents from the program file comes
+// from the text cache, and is read in and added to it on a
+// miss; it is mapped copy-on-write, so that processes
+// running the same program share it. May sleep.
+// Returns 0 on success, -1 if va is not in a segment or is
+// already mapped, or on error.
+int
+execfault(struct proc *p, uint64 va)
+{
+  struct seg *s;
+  uint64 off;
+  uint n;
+  char *mem;
+  int perm = PTE_W|PTE_X|PTE_R|PTE_U;
+
+  va = PGROUNDDOWN(va);
+  if((s = execseg(p, va)) == 0 || walkaddr(p->pagetable, va) != 0)
+    return -1;
+  off = va - s->va;
+  if(off < s->filesz){
+    n = s->filesz - off < PGSIZE ? s->filesz - off : PGSIZE;
+    ilock(p->exe);
+    if((mem = text_get(p->exe, s->off + off, n)) == 0){
+      if((mem = kalloc()) == 0){
+        iunlock(p->exe);
+        return -1;
+      }
+      memset(mem + n, 0, PGSIZE - n);
+      if(readi(p->exe, 0, (uint64)mem, s->off + off, n) != n){
+        iunlock(p->exe);
+        kfree(mem);
+        return -1;
+      }
+      text_put(p->exe, s->off + off, n, mem);
+    }
+    iunlock(p->exe);
+    perm = PTE_X|PTE_R|PTE_U|PTE_COW;
+  } else {
+    if((mem = kalloc()) == 0)
       return -1;
+    memset(mem, 0, PGSIZE);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
   }
-  
   return 0;
 }
@@ -12,17 +12,24 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+
+#define RA_MIN 4  // first readahead window, in blocks
+
+// open files come from a slab cache, so there is no fixed
+// limit on them. ftable.lock protects every f->ref.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -31,16 +38,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,10 +74,13 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
+    if(ff.type == FD_INODE && ff.writable)
+      iwriteput(ff.ip);
     begin_op();
     iput(ff.ip);
     end_op();
@@ -101,6 +106,49 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Sequential readahead. If a read of n bytes at f->off starts
+// where the last one ended, start reading the blocks after its
+// first into the buffer cache, up to a window past its end.
+// Whenever the reader gets within half a window of the end of
+// what has been started, start the next window, and double it,
+// up to NREADAHEAD blocks. Any other read closes the window.
+// Caller must hold f->ip->lock, which guards these fields as
+// it does f->off.
+static void
+readahead(struct file *f, uint n)
+{
+  struct inode *ip = f->ip;
+  uint bn, end, nblocks;
+
+  if(NREADAHEAD == 0)
+    return;
+  if(f->off != f->ra_off){
+    f->ra_off = f->off + n;
+    f->ra_win = 0;
+    return;
+  }
+  f->ra_off = f->off + n;
+
+  bn = f->off / BSIZE + 1;  // readi() is about to read the first
+  end = (f->off + n + BSIZE - 1) / BSIZE;
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  if(f->ra_win == 0)
+    f->ra_win = RA_MIN < NREADAHEAD ? RA_MIN : NREADAHEAD;
+  if(f->ra_next < bn)
+    f->ra_next = bn;
+  if(f->ra_next > end + f->ra_win / 2)
+    return;  // still well ahead of the reader
+  end += f->ra_win;
+  if(end > nblocks)
+    end = nblocks;
+  if(f->ra_next < end){
+    iprefetch(ip, f->ra_next, end);
+    f->ra_next = end;
+  }
+  if(f->ra_win < NREADAHEAD)
+    f->ra_win *= 2;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -118,7 +166,9 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    uvmprefault(addr, n);
     ilock(f->ip);
+    readahead(f, n);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
@@ -154,6 +204,7 @@ filewrite(struct file *f, uint64 addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
+    uvmprefault(addr, n);
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
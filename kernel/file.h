@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  uint ra_off;       // FD_INODE: where the last read ended
+  uint ra_next;      // FD_INODE: first block not read ahead yet
+  uint ra_win;       // FD_INODE: readahead window, in blocks
   short major;       // FD_DEVICE
 };
 
@@ -18,6 +21,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // itable hash chain
+  struct inode *lprev, *lnext; // itable LRU list, while ref is 0
+  int wcount;         // >0: files open to write it; <0: processes running it
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
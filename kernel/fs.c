@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -162,29 +163,89 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// In-memory inodes come from a slab cache and are found
+// through a hash table on (dev, inum), so there is no fixed
+// limit on how many can be in use. When its last reference is
+// dropped, a valid inode stays in the table, on an LRU list,
+// so that the next iget() of it need not read it from disk.
+// At most NICACHE inodes wait there, and iput() frees the
+// least recently used one beyond that; iget() recycles it
+// when the slab cache is out of memory.
+//
+// The itable.lock spin-lock protects the hash table, the LRU
+// list and the allocation of itable entries. Since ip->ref
+// indicates whether an entry is in use, and ip->dev and
+// ip->inum indicate which i-node an entry holds, one must hold
+// itable.lock while using any of those fields.
+//
+// ip->wcount, also protected by itable.lock, keeps a program
+// that some process is running from being written or
+// truncated under it: open() for writing fails while it is
+// negative, and exec() while it is positive.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and wcount.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache cache;
+  struct inode *hash[NINODE];
+
+  // inodes with ref 0, least recently used first.
+  struct inode *lru, *lrutail;
+  int nlru;
 } itable;
 
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NINODE)
+
+// Take ip off the LRU list. Caller must hold itable.lock.
+static void
+lru_remove(struct inode *ip)
+{
+  if(ip->lprev)
+    ip->lprev->lnext = ip->lnext;
+  else
+    itable.lru = ip->lnext;
+  if(ip->lnext)
+    ip->lnext->lprev = ip->lprev;
+  else
+    itable.lrutail = ip->lprev;
+  ip->lprev = ip->lnext = 0;
+  itable.nlru--;
+}
+
+// Remove ip from the hash table. Caller must hold itable.lock.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
+}
+
+// Take the least recently used unreferenced inode out of the
+// table and return it for reuse, or 0 if there is none.
+// Caller must hold itable.lock.
+static struct inode*
+ireclaim(void)
+{
+  struct inode *ip;
+
+  if((ip = itable.lru) == 0)
+    return 0;
+  lru_remove(ip);
+  iunhash(ip);
+  return ip;
+}
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  kmem_cache_init(&itable.cache, "inode", sizeof(struct inode));
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -242,31 +303,32 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **bucket;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  bucket = &itable.hash[IHASH(dev, inum)];
+  for(ip = *bucket; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lru_remove(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  // Allocate a new entry, or recycle an unused one.
+  if((ip = kmem_cache_alloc(&itable.cache)) == 0 && (ip = ireclaim()) == 0)
+    panic("iget: out of memory");
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->wcount = 0;
+  ip->next = *bucket;
+  *bucket = ip;
   release(&itable.lock);
 
   return ip;
@@ -283,6 +345,54 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Note that a file is open to write ip. Returns 0, or -1 if
+// some process is running ip as its program.
+int
+iwriteget(struct inode *ip)
+{
+  int r = -1;
+
+  acquire(&itable.lock);
+  if(ip->wcount >= 0){
+    ip->wcount++;
+    r = 0;
+  }
+  release(&itable.lock);
+  return r;
+}
+
+void
+iwriteput(struct inode *ip)
+{
+  acquire(&itable.lock);
+  ip->wcount--;
+  release(&itable.lock);
+}
+
+// Note that a process is running ip as its program. Returns
+// 0, or -1 if a file is open to write ip.
+int
+itextget(struct inode *ip)
+{
+  int r = -1;
+
+  acquire(&itable.lock);
+  if(ip->wcount <= 0){
+    ip->wcount--;
+    r = 0;
+  }
+  release(&itable.lock);
+  return r;
+}
+
+void
+itextput(struct inode *ip)
+{
+  acquire(&itable.lock);
+  ip->wcount++;
+  release(&itable.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -323,8 +433,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the inode table entry goes
+// on the LRU list, or is freed if it holds no valid inode.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -353,7 +463,22 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(ip->valid){
+      ip->lnext = 0;
+      ip->lprev = itable.lrutail;
+      if(itable.lrutail)
+        itable.lrutail->lnext = ip;
+      else
+        itable.lru = ip;
+      itable.lrutail = ip;
+      if(++itable.nlru > NICACHE)
+        kmem_cache_free(&itable.cache, ireclaim());
+    } else {
+      iunhash(ip);
+      kmem_cache_free(&itable.cache, ip);
+    }
+  }
   release(&itable.lock);
 }
 
@@ -413,6 +538,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  text_drop(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -476,6 +602,17 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Start reading blocks bn up to end of ip's data into the
+// buffer cache, for readahead.
+// Caller must hold ip->lock.
+void
+iprefetch(struct inode *ip, uint bn, uint end)
+{
+  for(; bn < end; bn++)
+    breadahead(ip->dev, bmap(ip, bn));
+  bunplug();
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -494,6 +631,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  text_drop(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
@@ -0,0 +1,135 @@
+// I/O scheduler.
+//
+// Disk requests wait here, in the order they arrived, until
+// the virtio driver has room for them. iosched_next() picks
+// the request to send next, and merges into it the queued
+// requests for the blocks right after it in the same
+// direction, so that the driver can send them all as one
+// multi-segment request.
+//
+// The IOSCHED make variable picks the policy the system boots
+// with. NOOP sends requests in the order they arrived. DEADLINE
+// (the default) sweeps up through the queued blocks from the
+// last one sent, wrapping around at the top, unless some read
+// has waited longer than READ_EXPIRE ticks or some write longer
+// than WRITE_EXPIRE. Then the one whose deadline passed first
+// goes next.
+//
+// The queue is protected by the driver's lock.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+
+#define IOSCHED_NOOP     0
+#define IOSCHED_DEADLINE 1
+#ifndef IOSCHED
+#define IOSCHED IOSCHED_DEADLINE
+#endif
+
+#define READ_EXPIRE  (HZ/2 > 0 ? HZ/2 : 1)  // half a second, or a tick
+#define WRITE_EXPIRE (5*HZ)
+
+static struct buf *head, *tail;  // queued, oldest first
+static uint lastblock;           // block after the last one sent
+
+// Queue b for the disk.
+void
+iosched_add(struct buf *b)
+{
+  b->deadline = ticks + (b->write ? WRITE_EXPIRE : READ_EXPIRE);
+  b->qnext = 0;
+  if(tail)
+    tail->qnext = b;
+  else
+    head = b;
+  tail = b;
+}
+
+static void
+dequeue(struct buf *b, struct buf *prev)
+{
+  if(prev)
+    prev->qnext = b->qnext;
+  else
+    head = b->qnext;
+  if(tail == b)
+    tail = prev;
+  b->qnext = 0;
+}
+
+// Choose the request to send next, and set *prevp to the one
+// queued before it.
+static struct buf*
+pick(struct buf **prevp)
+{
+  struct buf *b, *prev, *best = 0, *low = 0, *bestprev = 0, *lowprev = 0;
+
+  *prevp = 0;
+  if(IOSCHED == IOSCHED_NOOP)
+    return head;
+
+  // reads expire sooner than writes, so the oldest request
+  // need not be the first to expire.
+  for(prev = 0, b = head; b; prev = b, b = b->qnext){
+    if((int)(ticks - b->deadline) >= 0 &&
+       (best == 0 || (int)(b->deadline - best->deadline) < 0)){
+      best = b;
+      bestprev = prev;
+    }
+  }
+  if(best){
+    *prevp = bestprev;
+    return best;
+  }
+
+  for(prev = 0, b = head; b; prev = b, b = b->qnext){
+    if(b->blockno >= lastblock && (best == 0 || b->blockno < best->blockno)){
+      best = b;
+      bestprev = prev;
+    }
+    if(low == 0 || b->blockno < low->blockno){
+      low = b;
+      lowprev = prev;
+    }
+  }
+  if(best == 0){
+    best = low;  // wrap around
+    bestprev = lowprev;
+  }
+  *prevp = bestprev;
+  return best;
+}
+
+// Take the next request off the queue, with the requests merged
+// into it linked through qnext in block order. Returns 0 if
+// the queue is empty.
+struct buf*
+iosched_next(void)
+{
+  struct buf *first, *last, *b, *prev;
+  int n;
+
+  if(head == 0)
+    return 0;
+  first = last = pick(&prev);
+  dequeue(first, prev);
+  for(n = 1; n < MAXSEG; n++){
+    for(prev = 0, b = head; b; prev = b, b = b->qnext)
+      if(b->dev == first->dev && b->write == first->write &&
+         b->blockno == last->blockno + 1)
+        break;
+    if(b == 0)
+      break;
+    dequeue(b, prev);
+    last->qnext = b;
+    last = b;
+  }
+  lastblock = last->blockno + 1;
+  return first;
+}
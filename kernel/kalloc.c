@@ -1,12 +1,14 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and
+// physically contiguous blocks of 2^order pages.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "memstat.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -14,52 +16,234 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// a free block. the buddy lists are circular and doubly
+// linked; the per-cpu lists use only next.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
-struct {
+// Each cpu keeps a private list of free pages, so that most
+// kalloc() and kfree() calls take only that cpu's own lock.
+// A cpu refills its list from the global pool KBATCH pages at
+// a time when it runs dry, spills KBATCH pages back when it
+// has more than KMAXLOCAL, and steals half of another cpu's
+// pages when the pool is empty too.
+#define KBATCH    32
+#define KMAXLOCAL (2*KBATCH)
+
+struct kcpu {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;
+  uint64 nalloc;
+  uint64 nfreed;
+  uint64 nrefill;
+  uint64 nspill;
+  uint64 nsteal;
+} kcpus[NCPU];
+
+// The global pool is a buddy allocator. A free block of order
+// k is 2^k pages, aligned to its size relative to KERNBASE,
+// and sits on free[k]. order[] records k at the first page of
+// each free block, and -1 elsewhere, so that kfree_order() can
+// tell whether a block's buddy is free to merge with.
+#define NPAGE     ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PFN(pa)   (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PFN2PA(n) ((void*)(KERNBASE + (uint64)(n) * PGSIZE))
+
+struct {
+  struct spinlock lock;
+  struct run free[MAXORDER+1];
+  int nfree[MAXORDER+1];      // Free blocks of each order.
+  char order[NPAGE];
 } kmem;
 
+// Reference counts of the pages handed out by kalloc(), so
+// that fork can share pages copy-on-write. kfree() only frees
+// a page when it drops the last reference. Updated atomically,
+// without a lock.
+static int pageref[NPAGE];
+
+static void
+list_push(struct run *head, struct run *r)
+{
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+}
+
+static void
+list_remove(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+}
+
+// Take a block of 2^order pages from the buddy lists,
+// splitting a larger one if need be. Returns 0 if there is
+// none. Caller must hold kmem.lock.
+static struct run*
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER; k++)
+    if(kmem.nfree[k] > 0)
+      break;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.free[k].next;
+  list_remove(r);
+  kmem.nfree[k]--;
+  kmem.order[PFN(r)] = -1;
+
+  // give back the upper halves.
+  while(k > order){
+    struct run *b;
+    k--;
+    b = (struct run*)((char*)r + (PGSIZE << k));
+    list_push(&kmem.free[k], b);
+    kmem.nfree[k]++;
+    kmem.order[PFN(b)] = k;
+  }
+  return r;
+}
+
+// Return a block of 2^order pages to the buddy lists,
+// merging it with its buddy for as long as that is free.
+// Caller must hold kmem.lock.
+static void
+buddy_free(void *pa, int order)
+{
+  uint64 pfn = PFN(pa), buddy;
+
+  while(order < MAXORDER){
+    buddy = pfn ^ (1UL << order);
+    if(buddy >= NPAGE || kmem.order[buddy] != order)
+      break;
+    list_remove((struct run*)PFN2PA(buddy));
+    kmem.nfree[order]--;
+    kmem.order[buddy] = -1;
+    if(buddy < pfn)
+      pfn = buddy;
+    order++;
+  }
+  list_push(&kmem.free[order], (struct run*)PFN2PA(pfn));
+  kmem.nfree[order]++;
+  kmem.order[pfn] = order;
+}
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  memset(kmem.order, -1, sizeof(kmem.order));
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcpus[i].lock, "kmem_cpu");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Put all the pages of [pa_start, pa_end) in the global pool.
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
+
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  acquire(&kmem.lock);
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    memset(p, 1, PGSIZE);
+    buddy_free(p, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Take half the free pages of some other cpu, for cpu id,
+// whose own lock must not be held. Returns the pages as a list.
+static struct run*
+ksteal(int id, int *n)
+{
+  struct kcpu *k;
+  struct run *list = 0, *r;
+
+  *n = 0;
+  for(k = kcpus; k < &kcpus[NCPU]; k++){
+    if(k == &kcpus[id] || k->nfree == 0)
+      continue;
+    acquire(&k->lock);
+    while(*n < (k->nfree + 1) / 2 && (r = k->freelist) != 0){
+      k->freelist = r->next;
+      r->next = list;
+      list = r;
+      (*n)++;
+    }
+    k->nfree -= *n;
+    release(&k->lock);
+    if(*n > 0)
+      break;
+  }
+  return list;
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If the page is shared, just drop a reference.
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *spill = 0;
+  struct kcpu *k;
+  int n = 0, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&pageref[PFN(pa)], 1);
+  if(ref < 0)
+    panic("kfree: ref");
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  k = &kcpus[cpuid()];
+  acquire(&k->lock);
+  r->next = k->freelist;
+  k->freelist = r;
+  k->nfree++;
+  k->nfreed++;
+  if(k->nfree > KMAXLOCAL){
+    for(; n < KBATCH; n++){
+      r = k->freelist;
+      k->freelist = r->next;
+      r->next = spill;
+      spill = r;
+    }
+    k->nfree -= n;
+    k->nspill++;
+  }
+  release(&k->lock);
+  pop_off();
+
+  if(n > 0){
+    acquire(&kmem.lock);
+    while((r = spill) != 0){
+      spill = r->next;
+      buddy_free(r, 0);
+    }
+    release(&kmem.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -67,16 +251,150 @@ kfree(void *pa)
 // Returns 0 if the memory cannot be allocated.
 void *
 kalloc(void)
+{
+  struct run *r, *list = 0;
+  struct kcpu *k;
+  int id, n;
+
+  push_off();
+  id = cpuid();
+  k = &kcpus[id];
+  acquire(&k->lock);
+  if(k->freelist == 0){
+    acquire(&kmem.lock);
+    for(n = 0; n < KBATCH && (r = buddy_alloc(0)) != 0; n++){
+      r->next = k->freelist;
+      k->freelist = r;
+    }
+    release(&kmem.lock);
+    k->nfree += n;
+    if(n > 0)
+      k->nrefill++;
+  }
+  if(k->freelist == 0){
+    // don't hold our own lock while taking another
+    // cpu's, or two stealing cpus could deadlock.
+    release(&k->lock);
+    list = ksteal(id, &n);
+    acquire(&k->lock);
+    while((r = list) != 0){
+      list = r->next;
+      r->next = k->freelist;
+      k->freelist = r;
+    }
+    k->nfree += n;
+    if(n > 0)
+      k->nsteal++;
+  }
+  r = k->freelist;
+  if(r){
+    k->freelist = r->next;
+    k->nfree--;
+    k->nalloc++;
+  }
+  release(&k->lock);
+  pop_off();
+
+  if(r){
+    memset((char*)r, 5, PGSIZE); // fill with junk
+    pageref[PFN(r)] = 1;
+  }
+  return (void*)r;
+}
+
+// Add a reference to a page returned by kalloc().
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  __sync_fetch_and_add(&pageref[PFN(pa)], 1);
+}
+
+// The number of references to a page returned by kalloc().
+int
+krefcount(void *pa)
+{
+  return __sync_fetch_and_add(&pageref[PFN(pa)], 0);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size. Returns 0 if there is no free block that big.
+// Order 0 is the same as kalloc(). Each page gets a reference
+// count of 1, so the pages may also be freed one at a time
+// with kfree(), as when a megapage is unmapped.
+void *
+kalloc_order(int order)
 {
   struct run *r;
 
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = buddy_alloc(order);
   release(&kmem.lock);
-
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r){
+    memset((char*)r, 5, PGSIZE << order); // fill with junk
+    for(int i = 0; i < (1 << order); i++)
+      pageref[PFN(r) + i] = 1;
+  }
   return (void*)r;
 }
+
+// Free a block returned by kalloc_order(order), none of
+// whose pages may be shared.
+void
+kfree_order(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order > MAXORDER ||
+     ((uint64)pa % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+  for(int i = 0; i < (1 << order); i++){
+    if(pageref[PFN(pa) + i] != 1)
+      panic("kfree_order: ref");
+    pageref[PFN(pa) + i] = 0;
+  }
+  memset(pa, 1, PGSIZE << order);
+  acquire(&kmem.lock);
+  buddy_free(pa, order);
+  release(&kmem.lock);
+}
+
+// Fill in allocator statistics for the memstat() system call.
+void
+kmemstat(struct memstat *st)
+{
+  struct kcpu *k;
+
+  memset(st, 0, sizeof(*st));
+  acquire(&kmem.lock);
+  for(int i = 0; i <= MAXORDER; i++){
+    st->nfree_order[i] = kmem.nfree[i];
+    st->nfree += (uint64)kmem.nfree[i] << i;
+  }
+  st->lock_acquires = kmem.lock.nacquire;
+  st->lock_contended = kmem.lock.ncontended;
+  release(&kmem.lock);
+  for(k = kcpus; k < &kcpus[NCPU]; k++){
+    acquire(&k->lock);
+    st->nfree += k->nfree;
+    st->ncached += k->nfree;
+    st->nalloc += k->nalloc;
+    st->nfreed += k->nfreed;
+    st->nrefill += k->nrefill;
+    st->nspill += k->nspill;
+    st->nsteal += k->nsteal;
+    st->lock_acquires += k->lock.nacquire;
+    st->lock_contended += k->lock.ncontended;
+    release(&k->lock);
+  }
+  st->nslab = slab_pages();
+  st->ntext = text_pages();
+}
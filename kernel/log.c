@@ -4,6 +4,7 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -19,7 +20,17 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the next commit.
+//
+// Commits are group commits, done by the log flusher kernel
+// thread: it lets a transaction gather system calls for
+// COMMITMS milliseconds after its first block is logged, then
+// stops new ones from starting, waits for the outstanding ones
+// to end, and commits them all at once. It commits sooner if
+// begin_op() runs short of log space, or if fsync() calls
+// log_force() to wait for everything so far to be on disk.
+// So a system call's updates reach the disk some time after
+// end_op(), but still all or none of them.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +39,8 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but the blocks of each part of
+// a commit are written to the disk together.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -43,13 +55,22 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  uint seq;        // number of the transaction gathering sys calls.
+  uint done;       // number of the last one committed.
   int dev;
   struct logheader lh;
 };
 struct log log;
 
+// set to cut short the flusher's wait for more sys calls.
+// protected by tickslock, like the flusher's timer.
+static int hurry;
+
+#define COMMITTICKS ((COMMITMS * HZ + 999) / 1000)
+
 static void recover_from_log(void);
 static void commit();
+static void flusher(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -61,24 +82,32 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.seq = 1;
   recover_from_log();
+  if(kthread_create(flusher, "logflush") < 0)
+    panic("initlog: flusher");
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// The writes all go to the disk together.
 static void
 install_trans(int recovering)
 {
   int tail;
+  struct buf *dbuf[LOGSIZE];
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    dbuf[tail] = bread(log.dev, log.lh.block[tail]); // read dst
+    memmove(dbuf[tail]->data, lbuf->data, BSIZE);  // copy block to dst
+    bwrite_start(dbuf[tail]);  // write dst to disk
     brelse(lbuf);
-    brelse(dbuf);
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(dbuf[tail]);
+    if(recovering == 0)
+      bunpin(dbuf[tail]);
+    brelse(dbuf[tail]);
   }
 }
 
@@ -122,6 +151,17 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
+// Ask the flusher to commit now. Caller holds log.lock,
+// and the transaction has something in it.
+static void
+log_hurry(void)
+{
+  acquire(&tickslock);
+  hurry = 1;
+  wakeup(&hurry);
+  release(&tickslock);
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
@@ -132,6 +172,7 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      log_hurry();
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
@@ -142,51 +183,95 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// the flusher commits its updates later.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+  // begin_op() may be waiting for log space, and the flusher
+  // for the last outstanding op, and decrementing
+  // log.outstanding has helped both.
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// Wait until the updates of every FS system call that has
+// ended are on disk, for fsync().
+void
+log_force(void)
+{
+  uint want;
+
+  acquire(&log.lock);
+  if(log.lh.n > 0 || log.committing){
+    want = log.seq;
+    log_hurry();
+    while((int)(log.done - want) < 0)
+      sleep(&log, &log.lock);
   }
   release(&log.lock);
+}
+
+// The log flusher kernel thread.
+static void
+flusher(void)
+{
+  struct timer *t = &myproc()->timer;
+
+  for(;;){
+    // wait for a transaction to have something in it.
+    acquire(&log.lock);
+    while(log.lh.n == 0)
+      sleep(&log.lh, &log.lock);
+    release(&log.lock);
+
+    // let more sys calls join it, unless hurried.
+    acquire(&tickslock);
+    timer_add(t, ticks + COMMITTICKS, &hurry);
+    while(t->pending && !hurry)
+      sleep(&hurry, &tickslock);
+    timer_del(t);
+    hurry = 0;
+    release(&tickslock);
+
+    // stop new sys calls, and wait out the outstanding ones.
+    acquire(&log.lock);
+    log.committing = 1;
+    while(log.outstanding > 0)
+      sleep(&log, &log.lock);
+    release(&log.lock);
 
-  if(do_commit){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
+
     acquire(&log.lock);
     log.committing = 0;
+    log.done = log.seq++;
     wakeup(&log);
     release(&log.lock);
   }
 }
 
 // Copy modified blocks from cache to log.
+// The writes all go to the disk together.
 static void
 write_log(void)
 {
   int tail;
+  struct buf *to[LOGSIZE];
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    to[tail] = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    memmove(to[tail]->data, from->data, BSIZE);
+    bwrite_start(to[tail]);  // write the log
     brelse(from);
-    brelse(to);
+  }
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(to[tail]);
+    brelse(to[tail]);
   }
 }
 
@@ -230,6 +315,8 @@ log_write(struct buf *b)
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
     log.lh.n++;
+    if(log.lh.n == 1)
+      wakeup(&log.lh);  // the flusher's timer starts now
   }
   release(&log.lock);
 }
@@ -27,6 +27,8 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    textinit();      // program text cache
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -0,0 +1,16 @@
+// Physical page allocator statistics, returned by
+// the memstat() system call. Needs MAXORDER from param.h.
+struct memstat {
+  uint64 nfree;           // Free pages.
+  uint64 ncached;         // Of those, how many are on per-cpu lists.
+  uint64 nfree_order[MAXORDER+1]; // Free buddy blocks of each order.
+  uint64 nalloc;          // Pages handed out by kalloc().
+  uint64 nfreed;          // Pages returned by kfree().
+  uint64 nrefill;         // Batches cpus took from the global pool.
+  uint64 nspill;          // Batches cpus gave back to it.
+  uint64 nsteal;          // Times a cpu took pages from another cpu.
+  uint64 lock_acquires;   // Acquisitions of the allocator's locks.
+  uint64 lock_contended;  // How many of those had to spin.
+  uint64 nslab;           // Pages held by slab caches.
+  uint64 ntext;           // Pages in the program text cache.
+};
@@ -0,0 +1,268 @@
+// Memory mappings: mmap() and munmap().
+//
+// Each process has up to NVMA mappings in p->vma, placed one
+// below the other under TRAPFRAME, above the heap. mmap() only
+// records a mapping; vmafault() fills each page in the first
+// time it is touched, reading it from the file, or zeroing it
+// for an anonymous mapping. A MAP_SHARED file mapping writes
+// its dirty pages back to the file on munmap() and exit().
+//
+// Mapped pages are private to the mapping, not shared with the
+// buffer cache, so a write through a MAP_SHARED mapping only
+// reaches read() and other processes' mappings once it has
+// been written back. fork() shares MAP_SHARED pages with the
+// child, and MAP_PRIVATE pages copy-on-write.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "proc.h"
+
+// The mapping of p that va lies in, or 0.
+struct vma*
+vma_find(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len != 0 && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// The lowest address used by p's mappings: the heap
+// can grow up to here.
+uint64
+vma_base(struct proc *p)
+{
+  struct vma *v;
+  uint64 base = TRAPFRAME;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len != 0 && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Map len bytes of f from offset off, or anonymous memory if
+// f is 0, into the current process. Returns the address, or
+// -1. Every mapping is readable, whatever prot says.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 base;
+  int type = flags & (MAP_SHARED|MAP_PRIVATE);
+
+  if(len == 0 || (off % PGSIZE) != 0)
+    return -1;
+  if(type != MAP_SHARED && type != MAP_PRIVATE)
+    return -1;
+  if(f){
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    if(type == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+
+  len = PGROUNDUP(len);
+  base = vma_base(p);
+  if(len > base)
+    return -1;
+  base -= len;
+  // align big mappings so that they can use megapages.
+  if(len >= MEGASIZE)
+    base -= base % MEGASIZE;
+  if(base < PGROUNDUP(p->sz))
+    return -1;
+  v->addr = base;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  return v->addr;
+}
+
+// Fill in the page of p at va, which lies in one of p's
+// mappings and is not mapped yet. Reading it from a file
+// may sleep. Returns 0 on success, -1 on failure.
+int
+vmafault(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  char *mem;
+  int perm = PTE_U|PTE_R;
+
+  va = PGROUNDDOWN(va);
+  if((v = vma_find(p, va)) == 0 || walkaddr(p->pagetable, va) != 0)
+    return -1;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  // unlike the heap, an anonymous mapping gets a megapage for
+  // each untouched aligned block: it asked for that memory.
+  if(v->f == 0 && uvmmega(p->pagetable, va, v->addr, v->addr + v->len, perm) == 0)
+    return 0;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(v->f){
+    // past the end of the file, the page stays zero.
+    ilock(v->f->ip);
+    readi(v->f->ip, 0, (uint64)mem, v->off + (va - v->addr), PGSIZE);
+    iunlock(v->f->ip);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Write the dirty pages of v in [start, end) back to its
+// file, without growing the file.
+static void
+vma_writeback(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  // as in filewrite(), a few blocks per transaction.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  struct inode *ip = v->f->ip;
+  uint64 a, pa;
+  uint off, i, n;
+  pte_t *pte;
+
+  for(a = start; a < end; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    off = v->off + (a - v->addr);
+    for(i = 0; i < PGSIZE; i += n){
+      n = PGSIZE - i < max ? PGSIZE - i : max;
+      begin_op();
+      ilock(ip);
+      if(off + i >= ip->size){
+        iunlock(ip);
+        end_op();
+        break;
+      }
+      if(off + i + n > ip->size)
+        n = ip->size - (off + i);
+      writei(ip, 0, pa + i, off + i, n);
+      iunlock(ip);
+      end_op();
+    }
+  }
+}
+
+// Remove [start, end) from mapping v, which must be a prefix,
+// a suffix or all of it. Returns 0, or -1 if out of memory to
+// split a megapage, in which case v is unchanged. Removing all
+// of v cannot fail.
+static int
+vma_unmap(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  if(v->f && (v->flags & MAP_SHARED))
+    vma_writeback(p, v, start, end);
+  if(uvmunmap(p->pagetable, start, (end - start) / PGSIZE, 1) < 0)
+    return -1;
+  if(start == v->addr){
+    v->off += end - start;
+    v->addr = end;
+  }
+  v->len -= end - start;
+  if(v->len == 0){
+    if(v->f)
+      fileclose(v->f);
+    v->f = 0;
+  }
+  return 0;
+}
+
+// Unmap [addr, addr+len) from the current process. The range
+// must be at the start or the end of one mapping, or all of
+// it. Returns 0 on success, -1 on failure.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 end;
+
+  if((addr % PGSIZE) != 0 || len == 0)
+    return -1;
+  end = addr + PGROUNDUP(len);
+  if((v = vma_find(p, addr)) == 0 || end < addr || end > v->addr + v->len)
+    return -1;
+  if(addr != v->addr && end != v->addr + v->len)
+    return -1;
+  return vma_unmap(p, v, addr, end);
+}
+
+// Remove all of p's mappings, for exit() and exec().
+void
+vma_unmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len != 0)
+      vma_unmap(p, v, v->addr, v->addr + v->len);
+}
+
+// Give child np copies of p's mappings, for fork(). Pages
+// of MAP_SHARED mappings are shared, those of MAP_PRIVATE
+// ones copy-on-write. Returns 0 on success, -1 on failure,
+// in which case np has no mappings.
+int
+vma_copy(struct proc *p, struct proc *np)
+{
+  struct vma *v;
+  uint64 a;
+  int i, n;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(v->len == 0)
+      continue;
+    for(a = v->addr; a < v->addr + v->len; a += n){
+      if((n = uvmshare(p->pagetable, np->pagetable, a, v->flags & MAP_PRIVATE)) < 0){
+        uvmunmap(np->pagetable, v->addr, (a - v->addr) / PGSIZE, 1);
+        goto bad;
+      }
+    }
+    np->vma[i] = *v;
+    if(v->f)
+      filedup(v->f);
+  }
+  return 0;
+
+ bad:
+  // the parent still holds the files, so fileclose()
+  // only drops a reference and cannot sleep.
+  for(v = np->vma; v < &np->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    uvmunmap(np->pagetable, v->addr, v->len / PGSIZE, 1);
+    if(v->f)
+      fileclose(v->f);
+    v->len = 0;
+    v->f = 0;
+  }
+  return -1;
+}
@@ -1,13 +1,39 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NSEG          4  // loadable segments per program
+#define NVMA         16  // memory mappings per process
+#define NTEXT       256  // pages in the program text cache
+#ifndef NREADAHEAD
+#define NREADAHEAD   32  // max blocks of sequential file readahead, 0 for none
+#endif
+#define MAXSEG       32  // max blocks merged into one disk request
+#define NINODE       50  // buckets in the in-memory inode hash table
+#define NICACHE     200  // unreferenced inodes kept in memory
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*6)  // max data blocks in on-disk log
+#ifndef COMMITMS
+#define COMMITMS     100  // ms the log gathers FS ops before a commit
+#endif
+#ifndef NBUF
+#define NBUF       1024  // size of disk block cache
+#endif
+// a commit holds LOGSIZE pinned blocks, their LOGSIZE log
+// blocks and one more at once, and readers may be holding a
+// readahead window and a block per cpu meanwhile.
+#if NBUF < 2*LOGSIZE + 1 + NREADAHEAD + NCPU
+#error "NBUF is too small for a full log commit"
+#endif
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NUM_OF_QUEUES  5   // MLFQ priority levels
+#define MAX_OLD_AGE   50   // ticks a process may wait before MLFQ ageing
+#define NWAITQ        64   // sleep channel hash buckets
+#define MAXORDER      10   // largest kalloc_order() block is 2^MAXORDER pages
+#define TIMEBASE  10000000 // CLINT mtime and time CSR frequency in qemu (Hz)
+#ifndef HZ
+#define HZ            10   // timer interrupts (ticks) per second
+#endif
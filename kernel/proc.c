@@ -4,14 +4,10 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "cpustat.h"
 #include "defs.h"
 
-#ifndef SCHEDULER
-#define SCHEDULER 0
-#endif
-
-struct MLFQ_Queue mlfq_queue[NUM_OF_QUEUES];
-
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
@@ -32,6 +28,40 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Sleeping processes, hashed by channel, so that wakeup()
+// only looks at processes that might be sleeping on its
+// channel. A bucket's lock is acquired after the lock passed
+// to sleep() and before any p->lock.
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+static struct waitq*
+chan_waitq(void *chan)
+{
+  uint64 h = (uint64)chan;
+
+  h ^= h >> 17;
+  h *= 0x9E3779B97F4A7C15ULL;
+  return &waitq[(h >> 32) % NWAITQ];
+}
+
+// Unlink p from wq. Caller must hold wq->lock.
+static void
+waitq_remove(struct waitq *wq, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &wq->head; *pp; pp = &(*pp)->wq_next){
+    if(*pp == p){
+      *pp = p->wq_next;
+      break;
+    }
+  }
+  p->wq_next = 0;
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -53,15 +83,16 @@ void
 procinit(void)
 {
   struct proc *p;
-  
-  #if SCHEDULER==3
-  int i;
-  for(i=0;i<NUM_OF_QUEUES;i++)
-    mlfq_queue[i].arr[0]=0,mlfq_queue[i].num_procs=0;
-  #endif
+  struct cpu *c;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NWAITQ; i++)
+      initlock(&waitq[i].lock, "waitq");
+  for(c = cpus; c < &cpus[NCPU]; c++){
+      initlock(&c->rq.lock, "runq");
+      initlock(&c->hrlock, "hrtimer");
+  }
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -133,6 +164,10 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->cpu = 0;
+  p->policy = sched_default;
+  p->affinity = CPU_ALL;
+  p->rq_list = -1;
   p->trace_mask = 0;
   p->ctime=ticks;
   p->rtime=0;
@@ -144,14 +179,13 @@ found:
 
   p->scheduled_count=0;
   p->curr_queue=0;
+  p->qstart=ticks;
   for(int x=0;x<NUM_OF_QUEUES;x++)
     p->time_spent_queues[x]=0;
-  p->qwtime=0;
   p->qrtime=0;
   p->overshot_flag=0;
-  // #if SCHEDULER==3
-  //   add_into_mlfq(0, p);
-  // #endif
+  p->vruntime=0;
+  p->nice=0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -189,6 +223,8 @@ freeproc(struct proc *p)
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->asid = 0;
+  p->kfn = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -283,12 +319,43 @@ userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
+  runq_add(p);
 
+  release(&p->lock);
+}
+
+// A kernel thread's first scheduling switches to kthread_start,
+// which runs its body, like forkret() for a user process.
+static void
+kthread_start(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+  myproc()->kfn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn(), which must never return.
+// It has no user memory and never goes to user space.
+// Returns its pid, or -1.
+int
+kthread_create(void (*fn)(void), char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  p->kfn = fn;
+  p->context.ra = (uint64)kthread_start;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+
+  p->state = RUNNABLE;
+  runq_add(p);
 
   release(&p->lock);
-  #if SCHEDULER==3
-    add_into_mlfq(0, p);
-  #endif
+  return pid;
 }
 
 // Grow or shrink user memory by n bytes.
@@ -296,16 +363,20 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    // only reserve the addresses; the pages are allocated
+    // by uvmlazy() when first touched.
+    if(sz + n > vma_base(p))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if(uvmdealloc(p->pagetable, sz, sz + n) != sz + n)
+      return -1;
+    sz += n;
   }
   p->sz = sz;
   return 0;
@@ -332,6 +403,11 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  if(vma_copy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -340,12 +416,22 @@ fork(void)
   np->trapframe->a0 = 0;
 
   np->trace_mask=p->trace_mask;
+  np->policy=p->policy;
+  np->affinity=p->affinity;
+  np->vruntime=p->vruntime;
+  np->nice=p->nice;
 
   // increment reference counts on open file descriptors.
   for(i = 0; i < NOFILE; i++)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->exe){
+    itextget(p->exe);  // cannot fail: p is running it
+    np->exe = idup(p->exe);
+  }
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -359,13 +445,14 @@ fork(void)
 
   acquire(&np->lock);
   np->state = RUNNABLE;
-  //TODO: Insert the process into the 0th queue
+  // start the child on the parent's cpu; an idle cpu
+  // will steal it if this one is busy.
+  np->cpu = p->cpu;
+  runq_add(np);
   release(&np->lock);
-  #if SCHEDULER==3
-    add_into_mlfq(0, np);
-    if(p!=0 && p->curr_queue>0)
-      yield();
-  #endif
+  // an MLFQ child starts in queue 0; let it preempt us.
+  if(p->policy == SCHED_MLFQ && p->curr_queue>0)
+    yield();
 
   return pid;
 }
@@ -396,6 +483,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Write back and remove memory mappings.
+  vma_unmapall(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -405,10 +495,16 @@ exit(int status)
     }
   }
 
+  if(p->exe)
+    itextput(p->exe);
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
+  p->nseg = 0;
 
   acquire(&wait_lock);
 
@@ -440,6 +536,9 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the exit status is copied out under np->lock.
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int));
   acquire(&wait_lock);
 
   for(;;){
@@ -490,6 +589,9 @@ waitx(uint64 addr, uint* rtime, uint* wtime)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the exit status is copied out under np->lock.
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int));
   acquire(&wait_lock);
 
   for(;;){
@@ -532,75 +634,29 @@ waitx(uint64 addr, uint* rtime, uint* wtime)
   }
 }
 
-void
-update_time()
-{
-  struct proc* p;
-  for (p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if (p->state == RUNNING) {
-      p->rtime++;
-      p->pbs_rtime++;
-    }
-    else if(p->state == SLEEPING)
-    {
-      p->stime++;
-    }
-    //TODO: Update the number of ticks spent in this queue
-    release(&p->lock); 
-  }
-}
-
-void
-set_overshot_proc()
-{
-  struct proc* p = myproc();
-  acquire(&p->lock);
-  p->overshot_flag=1;
-  p->qrtime=0;
-  p->qwtime=0;
-  release(&p->lock);
-}
-
-void
-update_q_wtime()
-{
-  struct proc* p;
-  for (p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if (p->state == RUNNING) {
-      p->qrtime++;
-    }
-    else if(p->state == RUNNABLE)
-    {
-      p->qwtime++;
-    }
-    if(p->state != ZOMBIE)
-    {
-      p->time_spent_queues[p->curr_queue]++;
-    }
-    release(&p->lock); 
-  }
-}
-
-void
-remove_from_mlfq(int queue_no, int proc_idx)
+// Nothing to run: wait in wfi until an interrupt, rather
+// than spinning. sched_kick() sends an IPI when it queues
+// work while c->idle is set.
+static void
+cpu_idle(struct cpu *c)
 {
-  for(int x=proc_idx;x<mlfq_queue[queue_no].num_procs-1;x++)
-  {
-    mlfq_queue[queue_no].arr[x]=mlfq_queue[queue_no].arr[x+1];
+  uint64 t0;
+
+  intr_off();
+  c->idle = 1;
+  // order the store to c->idle before the run queue reads;
+  // sched_kick() does the opposite.
+  __sync_synchronize();
+  if(!sched_has_work(c)){
+    tick_stop();
+    t0 = r_time();
+    wfi();
+    c->idle_time += r_time() - t0;
+    c->wakeups++;
+    tick_start();
   }
-  mlfq_queue[queue_no].num_procs--;
-}
-
-void
-add_into_mlfq(int queue_no, struct proc* p)
-{
-  mlfq_queue[queue_no].arr[mlfq_queue[queue_no].num_procs]=p;
-  mlfq_queue[queue_no].num_procs++;
-  p->qrtime=0;
-  p->qwtime=0;
-  p->curr_queue=queue_no;
+  c->idle = 0;
+  intr_on();
 }
 
 // Per-CPU process scheduler.
@@ -613,260 +669,41 @@ add_into_mlfq(int queue_no, struct proc* p)
 void
 scheduler(void)
 {
-  #if SCHEDULER == 0
-  printf("ROUND ROBIN\n");
-  #endif
-  #if SCHEDULER == 1
-  printf("FCFS\n");
-  #endif
-  #if SCHEDULER == 2
-  printf("PBS\n");
-  #endif
-  #if SCHEDULER == 3
-  printf("MLFQ\n");
-  #endif
-  #if SCHEDULER == 0
+  printf("%s\n", sched_name(sched_default));
   struct proc *p;
   struct cpu *c = mycpu();
   
   c->proc = 0;
+  c->start = r_time();
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        p->scheduled_count++;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
-    }
-  }
-  #endif
-
-  #if SCHEDULER == 1
-  struct proc *p;
-  struct cpu *c = mycpu();
-  
-  c->proc = 0;
-  for(;;){
-    // Avoid deadlock by ensuring that devices can interrupt.
-    intr_on();
-    struct proc* lowest_time_proc = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        if(lowest_time_proc==0)
-        lowest_time_proc=p;
-        else if(p->ctime < lowest_time_proc->ctime)
-        lowest_time_proc=p;
-      }
-      release(&p->lock);
-    }
-    if(lowest_time_proc==0)
-    continue;
-    acquire(&lowest_time_proc->lock);
-      if(lowest_time_proc->state == RUNNABLE) {
-        // printf("RUNNING PROC %d\n", (int)lowest_time_proc->pid);
-        lowest_time_proc->scheduled_count++;
-        lowest_time_proc->state = RUNNING;
-        c->proc = lowest_time_proc;
-        // printf("PID: %d CPU: %d START TIME: %d\n", lowest_time_proc->pid, cpuid(), lowest_time_proc->ctime);
-        swtch(&c->context, &lowest_time_proc->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&lowest_time_proc->lock);
-  }
-  #endif
-
-  #if SCHEDULER==2
-  struct proc *p;
-  struct cpu *c = mycpu();
-  
-  c->proc = 0;
-  for(;;){
-    // Avoid deadlock by ensuring that devices can interrupt.
-    intr_on();
-    struct proc* highest_priority_proc = 0;
-    int highest_priority=110000;
-    for(p = proc; p < &proc[NPROC]; p++)
-    {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE)
-      {
-        int static_priority=p->static_priority;
-        int niceness=p->niceness;
-        int priority=static_priority-niceness+5;
-        // if(p->pid==8)
-        // {
-        //   printf("%d %d %d\n", static_priority, niceness, priority);
-        // }
-        if(priority<0)
-          priority=0;
-        else if(priority>100)
-          priority=100;
-        if(highest_priority_proc==0)
-        {
-          highest_priority_proc = p;
-          highest_priority = priority;
-        }
-        else if(priority < highest_priority)
-        {
-          release(&highest_priority_proc->lock);
-          highest_priority_proc = p;
-          highest_priority = priority;
-        }
-        else if(priority==highest_priority)
-        {
-          if(p->scheduled_count < highest_priority_proc->scheduled_count)
-          {
-            release(&highest_priority_proc->lock);
-            highest_priority_proc=p;
-            highest_priority=priority;
-          }
-          else if(p->scheduled_count==highest_priority_proc->scheduled_count && p->ctime < highest_priority_proc->ctime)
-          {
-            release(&highest_priority_proc->lock);
-            highest_priority_proc = p;
-            highest_priority = priority;
-          }
-          else
-            release(&p->lock);
-        }
-        else release(&p->lock);
-      }
-      else
-        release(&p->lock);
-    }
-    if(highest_priority_proc==0)
-      continue;
-    if(highest_priority_proc->state == RUNNABLE) 
-    {
-      highest_priority_proc->state = RUNNING;
-      c->proc = highest_priority_proc;
-      highest_priority_proc->scheduled_count+=1;
-      swtch(&c->context, &highest_priority_proc->context);
-
-      c->proc = 0;
-      if((highest_priority_proc->stime)+(highest_priority_proc->pbs_rtime) > 0)
-      {
-        int sum_of_val=(highest_priority_proc->stime)+(highest_priority_proc->pbs_rtime);
-        int sleep_time=highest_priority_proc->stime;
-        sleep_time=10*sleep_time;
-        if(sum_of_val != 0)
-        {
-          int new_niceness;
-          new_niceness = (sleep_time)/(sum_of_val);
-          highest_priority_proc->niceness=new_niceness;
-        }
-      }
-    }
-    release(&highest_priority_proc->lock);
-  }
-  #endif
-
-  #if SCHEDULER==3
-  struct cpu *c = mycpu();
-  c->proc = 0;
-  for(;;){
-    // Avoid deadlock by ensuring that devices can interrupt.
-    intr_on();
-    struct proc* proc_to_execute=0;
-
-    //TODO: Add ageing
-
-    for(int x=1;x<NUM_OF_QUEUES;x++)
-    {
-      // int queue_size=mlfq_queue[x].num_procs;
-      for(int y=0;y<mlfq_queue[x].num_procs;y++)
-      {
-        struct proc* ageing_proc;
-        ageing_proc=mlfq_queue[x].arr[y];
-        if(ageing_proc->qwtime>MAX_OLD_AGE && x>0)
-        {
-          // printf("AGEEEEEEEEEEEEEEEE");
-          remove_from_mlfq(x, y);
-          add_into_mlfq(x-1, ageing_proc);
-          y--;
-        }
-      }
-    }
-
-
-    for(int x=0;x<NUM_OF_QUEUES;x++)
-    {
-      // printf("%d\n", NUM_OF_QUEUES);
-      if(mlfq_queue[x].num_procs==0)
-        continue;
-      
-      for(int y=0;y<mlfq_queue[x].num_procs;y++)
-      {
-        acquire(&mlfq_queue[x].arr[y]->lock);
-        struct proc* temp_proc;
-        temp_proc=mlfq_queue[x].arr[y];
-        if(temp_proc->state!=RUNNABLE)
-        {
-          release(&temp_proc->lock);
-          continue;
-        }
-        proc_to_execute=temp_proc;
-        remove_from_mlfq(x,y);
-        break;
-      }
-      if(proc_to_execute!=0)
-        break;
-    }
-    if(proc_to_execute==0)
-    continue;
-
-    // printf("AAAAAAAAAAAAAAAAa");
-
-    if(proc_to_execute->state!=RUNNABLE)
-    {
-      release(&proc_to_execute->lock);
+    // Take the next process from this cpu's run queue,
+    // or steal one from a busier cpu if ours is empty.
+    if((p = sched_pick(c)) == 0){
+      cpu_idle(c);
       continue;
     }
 
-    // printf("AAAAAAAAAAAAAAAAa");
-    // printf("%d", proc_to_execute->pid);
-    proc_to_execute->qwtime=0;
-    proc_to_execute->state = RUNNING;
-    c->proc = proc_to_execute;
-    // printf("AAAAAAAAAAAAAAAAa");
-    swtch(&c->context, &proc_to_execute->context);
-
-    // Process is done running for now.
-    // It should have changed its p->state before coming back.
-    // printf("AAAAAAAAAAAAAAAAa");
-    c->proc = 0;
-    if(proc_to_execute->state==RUNNABLE)
-    {
-      if(proc_to_execute->overshot_flag==1)
-      {
-        if(proc_to_execute->curr_queue != NUM_OF_QUEUES-1)
-          proc_to_execute->curr_queue++;
-        proc_to_execute->overshot_flag=0;
-      }
-      add_into_mlfq(proc_to_execute->curr_queue, proc_to_execute);
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->scheduled_count++;
+      p->cpu = c - cpus;
+      c->proc = p;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
+      sched_put_prev(p);
     }
-    release(&proc_to_execute->lock);
-    // printf("BBBBBBBBBBBBBBBBBBBBBBBB\n");
+    release(&p->lock);
   }
-  #endif
-
 }
 
 // Switch to scheduler.  Must hold only p->lock
@@ -891,11 +728,6 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
-  //TODO: Insert into current queue
-  // #if SCHEDULER==3
-  //   mlfq_queue[p->curr_queue].arr[mlfq_queue[p->curr_queue].num_procs]=p;
-  //   mlfq_queue[p->curr_queue].num_procs++;
-  // #endif  
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -908,6 +740,7 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  runq_add(p);
   sched();
   release(&p->lock);
 }
@@ -939,14 +772,16 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = chan_waitq(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // Once we hold the bucket's lock and p->lock,
+  // we can be guaranteed that we won't miss any
+  // wakeup (wakeup locks both), so it's okay to
+  // release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
@@ -954,6 +789,10 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sleep_start = ticks;
+  p->wq_next = wq->head;
+  wq->head = p;
+  release(&wq->lock);
 
   sched();
 
@@ -967,25 +806,38 @@ sleep(void *chan, struct spinlock *lk)
 //-------------------------
 }
 
+// Make sleeping p RUNNABLE, charging it for the time it slept.
+// Caller must hold p->lock.
+static void
+wake(struct proc *p)
+{
+  p->stime += ticks - p->sleep_start;
+  p->state = RUNNABLE;
+  sched_wakeup(p);
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = chan_waitq(chan);
+  struct proc *p, **pp;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-        #if SCHEDULER==3
-          add_into_mlfq(p->curr_queue, p);
-        #endif
-      }
-      release(&p->lock);
+  acquire(&wq->lock);
+  for(pp = &wq->head; (p = *pp) != 0; ){
+    // p->lock is held by sleep() until p is off its cpu.
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      *pp = p->wq_next;
+      p->wq_next = 0;
+      wake(p);
+    } else {
+      pp = &p->wq_next;
     }
+    release(&p->lock);
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -995,14 +847,27 @@ int
 kill(int pid)
 {
   struct proc *p;
+  struct waitq *wq;
+  void *chan;
 
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
+      while(p->pid == pid && p->state == SLEEPING){
+        // Wake process from sleep(). Its bucket's lock
+        // must be taken before p->lock, so drop p->lock
+        // and check that it still sleeps on chan.
+        chan = p->chan;
+        release(&p->lock);
+        wq = chan_waitq(chan);
+        acquire(&wq->lock);
+        acquire(&p->lock);
+        if(p->state == SLEEPING && p->chan == chan){
+          waitq_remove(wq, p);
+          wake(p);
+        }
+        release(&wq->lock);
       }
       release(&p->lock);
       return 0;
@@ -1058,14 +923,13 @@ procdump(void)
   struct proc *p;
   char *state;
   int pid,rtime,wtime,nrun;
+  int mlfq = sched_default == SCHED_MLFQ;
   printf("PID\t");
-  #if SCHEDULER==2 || SCHEDULER==3
-  printf("Priority\t");
-  #endif
+  if(sched_default == SCHED_PBS || mlfq)
+    printf("Priority\t");
   printf("State\trtime\twtime\tnrun");
-  #if SCHEDULER==3
-  printf("\tq0\tq1\tq2\tq3\tq4");
-  #endif
+  if(mlfq)
+    printf("\tq0\tq1\tq2\tq3\tq4");
   printf("\n");
   for(p = proc; p < &proc[NPROC]; p++){
     if(p->state == UNUSED)
@@ -1076,30 +940,31 @@ procdump(void)
       state = "???";
     pid=p->pid;
     printf("%d\t", pid);
-    #if SCHEDULER==2
-      int static_priority=p->static_priority;
-      int niceness=p->niceness;
-      int priority=static_priority-niceness+5;
-      printf("%d\t\t", priority);
-    #elif SCHEDULER==3
-      int priority=p->curr_queue;
-      if(p->state==ZOMBIE)
-        priority = -1;
+    if(sched_default == SCHED_PBS || mlfq){
+      int priority=-1;
+      if(p->policy == SCHED_PBS)
+        priority=pbs_priority(p);
+      else if(p->policy == SCHED_MLFQ && p->state != ZOMBIE)
+        priority=p->curr_queue;
       printf("%d\t\t", priority);
-    #endif
+    }
     printf("%s\t", state);
-    #if SCHEDULER!=3
-    wtime = ticks - p->ctime - p->rtime;
-    #else
-    wtime=p->qwtime;
-    #endif
+    if(p->policy != SCHED_MLFQ)
+      wtime = ticks - p->ctime - p->rtime;
+    else if(p->state == RUNNABLE)
+      wtime = ticks - p->qenter;  // time waiting in its queue
+    else
+      wtime = 0;
     rtime=p->rtime;
     nrun=p->scheduled_count;
     printf("%d\t%d\t%d\t", rtime, wtime, nrun);
-    #if SCHEDULER==3
-    for(int x=0;x<NUM_OF_QUEUES;x++)
-    printf("%d\t", p->time_spent_queues[x]);
-    #endif
+    if(mlfq){
+      // time in the current queue is added lazily.
+      uint now = p->state == ZOMBIE ? p->etime : ticks;
+      for(int x=0;x<NUM_OF_QUEUES;x++)
+        printf("%d\t", p->time_spent_queues[x] +
+               (x == p->curr_queue ? now - p->qstart : 0));
+    }
     // printf("%d", p->ctime);
     printf("\n");
   }
@@ -1140,4 +1005,30 @@ set_priority(int static_priority, int pid)
     release(&p->lock);
   }
   return -1;
-}
\ No newline at end of file
+}
+// Copy statistics for up to n cpus to user address addr.
+// Returns the number of cpus copied, or -1.
+int
+cpustat(uint64 addr, int n)
+{
+  struct cpustat st;
+  struct cpu *c;
+  uint64 now = r_time();
+  int i;
+
+  if(n > NCPU)
+    n = NCPU;
+  for(i = 0; i < n; i++){
+    c = &cpus[i];
+    memset(&st, 0, sizeof(st));
+    if(c->start){
+      st.uptime = now - c->start;
+      st.idle = c->idle_time;
+      st.wakeups = c->wakeups;
+      st.ipis = c->ipis;
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return n;
+}
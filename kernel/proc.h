@@ -18,12 +18,40 @@ struct context {
   uint64 s11;
 };
 
+// one run queue list each for RR, FCFS and PBS, plus one per MLFQ level.
+#define NRQ (3+NUM_OF_QUEUES)
+
+// Per-CPU queue of RUNNABLE processes, kept by the scheduling
+// classes in sched.c. Each list is a FIFO linked through
+// p->rq_next and p->rq_prev. rq->lock protects the lists,
+// nonempty and len; it is always acquired after any p->lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NRQ];     // Next process to run on each list.
+  struct proc *tail[NRQ];
+  uint nonempty;              // Bit l is set iff list l is non-empty.
+  int len;                    // Number of queued processes.
+  int nallowed[NCPU];         // How many of them each cpu may run.
+  struct proc *heap[NPROC];   // CFS processes, min-heap on vruntime.
+  int nheap;
+  uint64 min_vruntime;        // Never decreases; places new CFS arrivals.
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct runq rq;             // RUNNABLE processes waiting for this cpu.
+  int idle;                   // Waiting in wfi; sched_kick() must IPI it.
+  uint64 start;               // r_time() when scheduler() started.
+  uint64 idle_time;           // r_time() cycles spent in wfi.
+  uint64 wakeups;             // Times woken from wfi.
+  uint64 ipis;                // IPIs received.
+  struct spinlock hrlock;
+  struct hrtimer *hrtimers;   // Pending hrtimers, earliest first.
+  uint64 asid_gen;            // ASID generation the TLB is clean for.
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +108,47 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A loadable segment of a process's program. exec() only
+// records it; execfault() reads each page in from the
+// program file the first time it is touched.
+struct seg {
+  uint64 va;                  // Page-aligned start address.
+  uint64 memsz;               // Size in memory.
+  uint off;                   // Offset in the program file.
+  uint filesz;                // Bytes read from the file; the rest is zero.
+};
+
+// A memory mapping made by mmap(); see mmap.c.
+// len is 0 if the slot is unused.
+struct vma {
+  uint64 addr;                // Page-aligned start address.
+  uint64 len;                 // Page-aligned length.
+  int prot;                   // PROT_ flags.
+  int flags;                  // MAP_ flags.
+  struct file *f;             // Mapped file, or 0 if anonymous.
+  uint off;                   // Offset of addr in the file.
+};
+
+// A one-shot timer on the timer wheel in timer.c.
+// tickslock must be held when using these fields.
+struct timer {
+  uint expires;               // Tick at which the timer fires.
+  int pending;                // Non-zero while on the wheel.
+  void *chan;                 // wakeup(chan) when it fires.
+  struct timer *next;         // Timer wheel slot links
+  struct timer **pprev;
+};
+
+// A high-resolution one-shot timer, on the list of the
+// cpu that armed it. That cpu's hrlock protects these fields.
+struct hrtimer {
+  uint64 expires;             // r_time() at which the timer fires.
+  int pending;                // Non-zero while on a cpu's list.
+  int cpu;                    // Cpu whose list it is on.
+  void *chan;                 // wakeup(chan) when it fires.
+  struct hrtimer *next;
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -92,6 +161,24 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Cpu whose run queue p goes on
+  int policy;                  // Scheduling class, SCHED_* in sched.h
+  uint64 affinity;             // Bit i set if p may run on cpu i
+
+  // the run queue's lock must be held when using these:
+  struct proc *rq_next;        // Run queue links
+  struct proc *rq_prev;
+  int rq_list;                 // Run queue list p is on, or -1
+  int heap_idx;                // Index in rq->heap if on the CFS heap
+
+  // the lock of p->chan's wait queue must be held when using this:
+  struct proc *wq_next;        // Next process sleeping in the same bucket
+
+  // tickslock must be held when using this:
+  struct timer timer;          // Wakes sys_sleep()
+
+  // cpus[p->hrtimer.cpu].hrlock must be held when using this:
+  struct hrtimer hrtimer;      // Wakes sys_nanosleep()
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -100,16 +187,24 @@ struct proc {
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  uint64 asid;                 // Generation and ASID it is tagged with
+  uint64 tlbstale;             // Bit i set if cpu i may cache old PTEs
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Program file, for execfault()
+  struct seg seg[NSEG];        // Its segments
+  int nseg;
+  struct vma vma[NVMA];        // Memory mappings
+  void (*kfn)(void);           // Body of a kernel thread, else 0
   char name[16];               // Process name (debugging)
 
   uint rtime;                   // How long the process ran for
   uint ctime;                   // When was the process created 
   uint etime;                   // When did the process exited
   uint stime;                   // How long the process sleeped
+  uint sleep_start;             // When the current sleep began
 
   int trace_mask;
   int static_priority;
@@ -121,7 +216,11 @@ struct proc {
   int curr_queue;
   int time_spent_queues[5];
   uint age;
-  uint qwtime;
   uint qrtime;
+  uint qstart;                  // When curr_queue last changed
+  uint qenter;                  // When p joined its current queue
   int overshot_flag;
+
+  uint64 vruntime;              // CFS: run time scaled by 1024/weight
+  int nice;                     // CFS: NICE_MIN..NICE_MAX, picks the weight
 };
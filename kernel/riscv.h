@@ -198,6 +198,13 @@ w_pmpaddr0(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// the address-space identifier field of satp. the hardware
+// may implement fewer than ASIDBITS bits of it.
+#define ASIDBITS 16
+#define ASIDMASK ((1L << ASIDBITS) - 1)
+#define SATP_ASID(asid) (((uint64)(asid) & ASIDMASK) << 44)
+#define SATP2ASID(satp) (((satp) >> 44) & ASIDMASK)
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -269,6 +276,14 @@ r_time()
   return x;
 }
 
+// wait for an interrupt. returns when one is pending
+// and enabled in sie, even if interrupts are off.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 // enable device interrupts
 static inline void
 intr_on()
@@ -331,6 +346,13 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -338,11 +360,17 @@ sfence_vma()
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+#define MEGAORDER 9                      // a megapage is 2^9 pages,
+#define MEGASIZE (PGSIZE << MEGAORDER)   // mapped by a level-1 leaf PTE
+
 #define PTE_V (1L << 0) // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // RSW bit: copy-on-write page, see uvmcow()
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -351,6 +379,10 @@ sfence_vma()
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a valid PTE with any of R, W, X maps memory, else it
+// points to a lower-level page table.
+#define PTE_LEAF(pte) ((pte) & (PTE_R|PTE_W|PTE_X))
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
@@ -0,0 +1,735 @@
+// Scheduling classes and per-CPU run queues.
+//
+// Every process belongs to one scheduling class (p->policy),
+// and each class is a table of operations that scheduler()
+// and the trap handlers call through:
+//   pick_next -- choose the next process from a run queue
+//                that may run on a given cpu.
+//   enqueue   -- add a RUNNABLE process to a run queue.
+//   dequeue   -- take a queued process off a run queue.
+//   tick      -- timer interrupt while p runs; should p yield?
+//   on_wakeup -- p is about to be requeued after sleeping.
+//   put_prev  -- p has just stopped running.
+// All five policies are compiled in; sched_setpolicy() moves
+// one process or the whole system to another class at runtime.
+// The SCHEDULER make variable only picks the boot-time default.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sched.h"
+#include "defs.h"
+
+#ifndef SCHEDULER
+#define SCHEDULER SCHED_RR
+#endif
+
+extern struct proc proc[NPROC];
+
+// run queue lists used by each class.
+#define RQ_RR    0
+#define RQ_FCFS  1
+#define RQ_PBS   2
+#define RQ_MLFQ  3   // MLFQ level l uses list RQ_MLFQ+l
+#define RQ_CFS   NRQ // not a list: p is on rq->heap
+
+struct sched_class {
+  char *name;
+  struct proc* (*pick_next)(struct runq*, int);
+  void (*enqueue)(struct runq*, struct proc*);
+  void (*dequeue)(struct runq*, struct proc*);
+  int (*tick)(struct proc*);
+  void (*on_wakeup)(struct proc*);
+  void (*put_prev)(struct proc*);
+};
+
+// policy given to processes created by userinit(),
+// and reported by sched_setpolicy(0, ...).
+int sched_default = SCHEDULER;
+
+// May p run on cpu id?
+static int
+allowed(struct proc *p, int id)
+{
+  return (p->affinity >> id) & 1;
+}
+
+// Add d to the count of queued processes on rq that
+// each cpu in p's affinity mask could run.
+static void
+rq_count(struct runq *rq, struct proc *p, int d)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(allowed(p, i))
+      rq->nallowed[i] += d;
+}
+
+// Append p to list l of rq. Caller must hold rq->lock.
+static void
+rq_append(struct runq *rq, int l, struct proc *p)
+{
+  rq_count(rq, p, 1);
+  p->qenter = ticks;
+  p->rq_list = l;
+  p->rq_next = 0;
+  p->rq_prev = rq->tail[l];
+  if(rq->tail[l])
+    rq->tail[l]->rq_next = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+  rq->nonempty |= 1 << l;
+  rq->len++;
+}
+
+// Unlink p from whichever list of rq it is on.
+// Caller must hold rq->lock.
+static void
+rq_remove(struct runq *rq, struct proc *p)
+{
+  int l = p->rq_list;
+
+  if(p->rq_prev)
+    p->rq_prev->rq_next = p->rq_next;
+  else
+    rq->head[l] = p->rq_next;
+  if(p->rq_next)
+    p->rq_next->rq_prev = p->rq_prev;
+  else
+    rq->tail[l] = p->rq_prev;
+  p->rq_next = p->rq_prev = 0;
+  p->rq_list = -1;
+  if(rq->head[l] == 0)
+    rq->nonempty &= ~(1 << l);
+  rq->len--;
+  rq_count(rq, p, -1);
+}
+
+// First process on list l of rq that may run on cpu id.
+static struct proc*
+rq_first(struct runq *rq, int l, int id)
+{
+  struct proc *p;
+
+  for(p = rq->head[l]; p; p = p->rq_next)
+    if(allowed(p, id))
+      return p;
+  return 0;
+}
+
+// Round robin: a single FIFO, preempted on every tick.
+
+static struct proc*
+rr_pick_next(struct runq *rq, int id)
+{
+  return rq_first(rq, RQ_RR, id);
+}
+
+static void
+rr_enqueue(struct runq *rq, struct proc *p)
+{
+  rq_append(rq, RQ_RR, p);
+}
+
+static int
+rr_tick(struct proc *p)
+{
+  return 1;
+}
+
+// FCFS: oldest process first, never preempted by the timer.
+
+static struct proc*
+fcfs_pick_next(struct runq *rq, int id)
+{
+  struct proc *p, *best = rq_first(rq, RQ_FCFS, id);
+
+  for(p = best; p; p = p->rq_next)
+    if(allowed(p, id) && p->ctime < best->ctime)
+      best = p;
+  return best;
+}
+
+static void
+fcfs_enqueue(struct runq *rq, struct proc *p)
+{
+  rq_append(rq, RQ_FCFS, p);
+}
+
+static int
+fcfs_tick(struct proc *p)
+{
+  return 0;
+}
+
+// PBS: lowest dynamic priority first, ties broken by
+// how often the process has run and then by age.
+
+int
+pbs_priority(struct proc *p)
+{
+  int priority=p->static_priority-p->niceness+5;
+  if(priority<0)
+    priority=0;
+  else if(priority>100)
+    priority=100;
+  return priority;
+}
+
+static struct proc*
+pbs_pick_next(struct runq *rq, int id)
+{
+  struct proc *p, *best = rq_first(rq, RQ_PBS, id);
+
+  for(p = best; p; p = p->rq_next){
+    if(!allowed(p, id))
+      continue;
+    int prio = pbs_priority(p), bprio = pbs_priority(best);
+    if(prio < bprio ||
+       (prio == bprio && p->scheduled_count < best->scheduled_count) ||
+       (prio == bprio && p->scheduled_count == best->scheduled_count &&
+        p->ctime < best->ctime))
+      best = p;
+  }
+  return best;
+}
+
+static void
+pbs_enqueue(struct runq *rq, struct proc *p)
+{
+  rq_append(rq, RQ_PBS, p);
+}
+
+// recompute niceness from the share of time p spent asleep.
+static void
+pbs_put_prev(struct proc *p)
+{
+  if((p->stime)+(p->pbs_rtime) > 0)
+  {
+    int sum_of_val=(p->stime)+(p->pbs_rtime);
+    int sleep_time=p->stime;
+    sleep_time=10*sleep_time;
+    p->niceness=(sleep_time)/(sum_of_val);
+  }
+}
+
+// MLFQ: NUM_OF_QUEUES FIFO levels, level 0 first.
+// A process that uses up its 1<<level tick slice moves
+// down a level; one that waits longer than MAX_OLD_AGE
+// ticks moves up.
+
+// Move p to MLFQ level l, adding the time it spent on its
+// old level to time_spent_queues. Caller must hold p->lock,
+// or rq->lock if p is queued.
+static void
+mlfq_setlevel(struct proc *p, int l)
+{
+  p->time_spent_queues[p->curr_queue] += ticks - p->qstart;
+  p->qstart = ticks;
+  p->curr_queue = l;
+}
+
+// Each level is FIFO, so its head is the process that has
+// waited longest, and ageing stops at the first head that
+// is young enough.
+static void
+mlfq_age(struct runq *rq)
+{
+  struct proc *p;
+
+  for(int l = 1; l < NUM_OF_QUEUES; l++){
+    while((p = rq->head[RQ_MLFQ+l]) != 0 && ticks - p->qenter > MAX_OLD_AGE){
+      rq_remove(rq, p);
+      mlfq_setlevel(p, l-1);
+      p->qrtime=0;
+      rq_append(rq, RQ_MLFQ+l-1, p);
+    }
+  }
+}
+
+static struct proc*
+mlfq_pick_next(struct runq *rq, int id)
+{
+  struct proc *p;
+  int l;
+
+  mlfq_age(rq);
+  for(l = 0; l < NUM_OF_QUEUES; l++)
+    if((rq->nonempty & (1 << (RQ_MLFQ+l))) && (p = rq_first(rq, RQ_MLFQ+l, id)) != 0)
+      return p;
+  return 0;
+}
+
+static void
+mlfq_enqueue(struct runq *rq, struct proc *p)
+{
+  // used up its time slice: move down a level.
+  if(p->overshot_flag){
+    if(p->curr_queue < NUM_OF_QUEUES-1)
+      mlfq_setlevel(p, p->curr_queue+1);
+    p->overshot_flag=0;
+  }
+  p->qrtime=0;
+  rq_append(rq, RQ_MLFQ+p->curr_queue, p);
+}
+
+static int
+mlfq_tick(struct proc *p)
+{
+  if(p->qrtime < (1 << p->curr_queue))
+    return 0;
+  p->overshot_flag=1;
+  p->qrtime=0;
+  return 1;
+}
+
+// CFS: each process accumulates virtual runtime at a rate
+// inversely proportional to its weight, and the process with
+// the least virtual runtime runs next. Runnable processes are
+// kept in a per-cpu binary min-heap, so picking is O(1) and
+// insertion and removal are O(log n).
+
+// weight of nice values -20..19, from Linux's
+// sched_prio_to_weight: each step is about 1.25x.
+static const int cfs_weights[NICE_MAX-NICE_MIN+1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+#define CFS_NICE0_WEIGHT 1024
+
+// how far behind min_vruntime a process may be placed, so that
+// sleepers get a little credit but cannot starve everyone else.
+#define CFS_SLEEP_CREDIT (CFS_NICE0_WEIGHT*2)
+
+static void
+heap_set(struct runq *rq, int i, struct proc *p)
+{
+  rq->heap[i] = p;
+  p->heap_idx = i;
+}
+
+static void
+heap_up(struct runq *rq, int i)
+{
+  struct proc *p = rq->heap[i];
+
+  while(i > 0 && rq->heap[(i-1)/2]->vruntime > p->vruntime){
+    heap_set(rq, i, rq->heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  heap_set(rq, i, p);
+}
+
+static void
+heap_down(struct runq *rq, int i)
+{
+  struct proc *p = rq->heap[i];
+  int c;
+
+  while((c = 2*i+1) < rq->nheap){
+    if(c+1 < rq->nheap && rq->heap[c+1]->vruntime < rq->heap[c]->vruntime)
+      c++;
+    if(rq->heap[c]->vruntime >= p->vruntime)
+      break;
+    heap_set(rq, i, rq->heap[c]);
+    i = c;
+  }
+  heap_set(rq, i, p);
+}
+
+static struct proc*
+cfs_pick_next(struct runq *rq, int id)
+{
+  struct proc *p = 0;
+  int i;
+
+  if(rq->nheap == 0)
+    return 0;
+  if(allowed(rq->heap[0], id)){
+    p = rq->heap[0];
+  } else {
+    // stealing, and the leftmost process is pinned here:
+    // settle for the least vruntime this cpu may run.
+    for(i = 1; i < rq->nheap; i++)
+      if(allowed(rq->heap[i], id) && (p == 0 || rq->heap[i]->vruntime < p->vruntime))
+        p = rq->heap[i];
+    return p;
+  }
+  if(p->vruntime > rq->min_vruntime)
+    rq->min_vruntime = p->vruntime;
+  return p;
+}
+
+static void
+cfs_enqueue(struct runq *rq, struct proc *p)
+{
+  // a process that slept, or that last ran on another cpu,
+  // must not come back far behind everyone queued here.
+  if(p->vruntime + CFS_SLEEP_CREDIT < rq->min_vruntime)
+    p->vruntime = rq->min_vruntime - CFS_SLEEP_CREDIT;
+  p->qenter = ticks;
+  p->rq_list = RQ_CFS;
+  heap_set(rq, rq->nheap++, p);
+  heap_up(rq, p->heap_idx);
+  rq->len++;
+  rq_count(rq, p, 1);
+}
+
+static void
+cfs_dequeue(struct runq *rq, struct proc *p)
+{
+  struct proc *last;
+  int i = p->heap_idx;
+
+  // move the last entry into p's slot, then restore the heap
+  // in whichever direction it is out of order.
+  last = rq->heap[--rq->nheap];
+  if(last != p){
+    heap_set(rq, i, last);
+    heap_up(rq, i);
+    heap_down(rq, last->heap_idx);
+  }
+  rq->heap[rq->nheap] = 0;
+  p->rq_list = -1;
+  rq->len--;
+  rq_count(rq, p, -1);
+}
+
+// charge p for one tick, and preempt it once some queued
+// process has less virtual runtime.
+static int
+cfs_tick(struct proc *p)
+{
+  struct runq *rq = &cpus[p->cpu].rq;
+  int r;
+
+  p->vruntime += (CFS_NICE0_WEIGHT << 10) / cfs_weights[p->nice-NICE_MIN];
+  acquire(&rq->lock);
+  r = rq->nheap > 0 && rq->heap[0]->vruntime < p->vruntime;
+  release(&rq->lock);
+  return r;
+}
+
+static struct sched_class classes[NSCHED] = {
+[SCHED_RR]   { "ROUND ROBIN", rr_pick_next, rr_enqueue, rq_remove, rr_tick, 0, 0 },
+[SCHED_FCFS] { "FCFS", fcfs_pick_next, fcfs_enqueue, rq_remove, fcfs_tick, 0, 0 },
+[SCHED_PBS]  { "PBS", pbs_pick_next, pbs_enqueue, rq_remove, rr_tick, 0, pbs_put_prev },
+[SCHED_MLFQ] { "MLFQ", mlfq_pick_next, mlfq_enqueue, rq_remove, mlfq_tick, 0, 0 },
+[SCHED_CFS]  { "CFS", cfs_pick_next, cfs_enqueue, cfs_dequeue, cfs_tick, 0, 0 },
+};
+
+// When processes of several classes share a cpu, the
+// classes are tried in this order: the run-to-completion
+// class first, then round robin, then the adaptive ones,
+// and the fair-share class last.
+static int class_order[NSCHED] = { SCHED_FCFS, SCHED_RR, SCHED_PBS, SCHED_MLFQ, SCHED_CFS };
+
+char*
+sched_name(int policy)
+{
+  if(policy < 0 || policy >= NSCHED)
+    return "???";
+  return classes[policy].name;
+}
+
+// The cpu in p's affinity mask with the shortest run queue,
+// among those that have started. Caller must hold p->lock.
+static int
+affine_cpu(struct proc *p)
+{
+  int i, best = -1;
+
+  for(i = 0; i < NCPU; i++){
+    if(!allowed(p, i) || cpus[i].start == 0)
+      continue;
+    if(best < 0 || cpus[i].rq.len < cpus[best].rq.len)
+      best = i;
+  }
+  return best < 0 ? p->cpu : best;
+}
+
+// Add p to the run queue of cpu p->cpu, or of a cpu in its
+// affinity mask if p->cpu is not.
+// Caller must hold p->lock and have set p->state to RUNNABLE.
+void
+runq_add(struct proc *p)
+{
+  struct runq *rq;
+
+  if(!allowed(p, p->cpu))
+    p->cpu = affine_cpu(p);
+  rq = &cpus[p->cpu].rq;
+  acquire(&rq->lock);
+  classes[p->policy].enqueue(rq, p);
+  release(&rq->lock);
+  sched_kick(p);
+}
+
+// p has been queued on cpu p->cpu: wake that cpu if it is
+// idle, or else wake some other idle cpu that may run p, to
+// steal it.
+void
+sched_kick(struct proc *p)
+{
+  struct cpu *c;
+
+  // order the run queue update before reading c->idle;
+  // cpu_idle() does the opposite.
+  __sync_synchronize();
+  c = &cpus[p->cpu];
+  if(c->idle && __sync_bool_compare_and_swap(&c->idle, 1, 0)){
+    ipi_send(c - cpus);
+    return;
+  }
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c->idle && allowed(p, c - cpus) &&
+       __sync_bool_compare_and_swap(&c->idle, 1, 0)){
+      ipi_send(c - cpus);
+      return;
+    }
+  }
+}
+
+// Is there anything cpu c could run, either from
+// its own run queue or by stealing?
+int
+sched_has_work(struct cpu *c)
+{
+  struct cpu *v;
+
+  for(v = cpus; v < &cpus[NCPU]; v++)
+    if(v->rq.nallowed[c - cpus] > 0)
+      return 1;
+  return 0;
+}
+
+// Requeue p, which was SLEEPING and is now RUNNABLE.
+// Caller must hold p->lock.
+void
+sched_wakeup(struct proc *p)
+{
+  struct sched_class *cl = &classes[p->policy];
+
+  if(cl->on_wakeup)
+    cl->on_wakeup(p);
+  runq_add(p);
+}
+
+// Remove and return the process that should run next on
+// cpu id from rq, or 0 if rq has nothing id may run.
+static struct proc*
+runq_pick(struct runq *rq, int id)
+{
+  struct sched_class *cl;
+  struct proc *p = 0;
+
+  if(rq->nallowed[id] == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  for(int i = 0; i < NSCHED && p == 0; i++){
+    cl = &classes[class_order[i]];
+    if((p = cl->pick_next(rq, id)) != 0)
+      cl->dequeue(rq, p);
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Choose the next process for cpu c: from its own run queue,
+// or, if that is empty, from the cpu with the most queued
+// processes that c may run. nallowed is read without the
+// lock, which is fine since it is only a hint.
+struct proc*
+sched_pick(struct cpu *c)
+{
+  struct cpu *victim = 0, *v;
+  struct proc *p;
+  int id = c - cpus, maxlen = 0;
+
+  if((p = runq_pick(&c->rq, id)) != 0)
+    return p;
+
+  for(v = cpus; v < &cpus[NCPU]; v++){
+    if(v != c && v->rq.nallowed[id] > maxlen){
+      maxlen = v->rq.nallowed[id];
+      victim = v;
+    }
+  }
+  if(victim == 0)
+    return 0;
+  return runq_pick(&victim->rq, id);
+}
+
+// p has just given up the cpu and scheduler() still holds p->lock.
+void
+sched_put_prev(struct proc *p)
+{
+  struct sched_class *cl = &classes[p->policy];
+
+  if(cl->put_prev)
+    cl->put_prev(p);
+}
+
+// Called on every hart's timer interrupt, to charge the
+// current process for the tick.
+// Returns 1 if it should yield.
+int
+sched_tick(void)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(p == 0)
+    return 0;
+  acquire(&p->lock);
+  r = 0;
+  if(p->state == RUNNING){
+    // each hart charges its own process at its own tick.
+    p->rtime++;
+    p->pbs_rtime++;
+    p->qrtime++;
+    r = classes[p->policy].tick(p);
+  }
+  release(&p->lock);
+  return r;
+}
+
+// Move p to class policy. Caller must hold p->lock.
+static void
+setpolicy_locked(struct proc *p, int policy)
+{
+  struct runq *rq;
+
+  if(p->policy == policy)
+    return;
+  rq = &cpus[p->cpu].rq;
+  acquire(&rq->lock);
+  if(p->rq_list >= 0){
+    classes[p->policy].dequeue(rq, p);
+    p->policy = policy;
+    classes[policy].enqueue(rq, p);
+  } else {
+    p->policy = policy;
+  }
+  release(&rq->lock);
+}
+
+// Switch process pid, or every process if pid is 0, to
+// scheduling policy policy. With pid 0 the policy also
+// becomes the default. Returns the previous policy, or -1.
+int
+sched_setpolicy(int pid, int policy)
+{
+  struct proc *p;
+  int old = -1;
+
+  if(policy < 0 || policy >= NSCHED)
+    return -1;
+
+  if(pid == 0){
+    old = sched_default;
+    sched_default = policy;
+  }
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && (pid == 0 || p->pid == pid)){
+      if(pid != 0)
+        old = p->policy;
+      setpolicy_locked(p, policy);
+    }
+    release(&p->lock);
+  }
+  return old;
+}
+
+// Set the CFS nice value of process pid.
+// Returns the previous nice value, or -1.
+int
+sched_setnice(int pid, int nice)
+{
+  struct proc *p;
+  int old;
+
+  if(nice < NICE_MIN || nice > NICE_MAX)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid){
+      old = p->nice;
+      p->nice = nice;
+      release(&p->lock);
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Restrict process pid to the cpus in mask.
+// Returns 0, or -1 if there is no such process or
+// mask has no cpu that is running.
+int
+sched_setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  struct runq *rq;
+  int i, queued;
+
+  mask &= CPU_ALL;
+  for(i = 0; i < NCPU; i++)
+    if(((mask >> i) & 1) && cpus[i].start)
+      break;
+  if(i == NCPU)
+    return -1;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid){
+      // take p off its run queue, so that it is counted
+      // under the new mask, and so that runq_add() can
+      // move it if its cpu is no longer allowed.
+      rq = &cpus[p->cpu].rq;
+      acquire(&rq->lock);
+      queued = p->rq_list >= 0;
+      if(queued)
+        classes[p->policy].dequeue(rq, p);
+      release(&rq->lock);
+      p->affinity = mask;
+      if(queued)
+        runq_add(p);
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Returns the affinity mask of process pid, or -1.
+uint64
+sched_getaffinity(int pid)
+{
+  struct proc *p;
+  uint64 mask;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid){
+      mask = p->affinity;
+      release(&p->lock);
+      return mask;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
@@ -0,0 +1,17 @@
+// Scheduling policies, for sched_setpolicy().
+// The values match the SCHEDULER make variable,
+// which picks the policy the system boots with.
+#define SCHED_RR    0   // round robin
+#define SCHED_FCFS  1   // first come, first served
+#define SCHED_PBS   2   // priority based
+#define SCHED_MLFQ  3   // multi-level feedback queue
+#define SCHED_CFS   4   // weighted fair share by virtual runtime
+#define NSCHED      5
+
+// affinity mask with every cpu set, for sched_setaffinity().
+// Needs NCPU from param.h.
+#define CPU_ALL ((1ULL << NCPU) - 1)
+
+// nice values for setnice(), which weight CFS processes.
+#define NICE_MIN  -20
+#define NICE_MAX   19
@@ -0,0 +1,183 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved out of
+// whole pages ("slabs") from kalloc(). Each slab starts with
+// a struct slab header followed by perslab objects, and keeps
+// its free objects on a list, so an object's slab is found by
+// rounding its address down to a page. Slabs with free objects
+// are on the cache's partial list; a slab whose objects are
+// all free goes back to kalloc().
+//
+// In front of the slabs each cpu has a magazine of up to
+// MAGSIZE free objects, used with interrupts off rather than
+// a lock, so that most allocations and frees touch neither
+// the cache lock nor another cpu's memory.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+#define NCACHE 8
+
+// every cache, for slab_pages().
+static struct kmem_cache *caches[NCACHE];
+static int ncache;
+
+struct slab {
+  struct slab *next;      // on cache->partial
+  struct slab *prev;
+  int inuse;              // objects handed out
+  void *free;             // free objects, linked through their first word
+};
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->size;
+  if(c->perslab < 1)
+    panic("kmem_cache_init: object too big");
+  initlock(&c->lock, name);
+  c->partial = 0;
+  c->nslab = 0;
+  c->nobj = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+  if(ncache == NCACHE)
+    panic("kmem_cache_init: too many caches");
+  caches[ncache++] = c;
+}
+
+static void
+partial_remove(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+partial_push(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Take one object from the slabs, allocating a new slab
+// if none has a free object. Caller must hold c->lock.
+static void*
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->inuse = 0;
+    s->free = 0;
+    p = (char*)(s + 1);
+    for(int i = 0; i < c->perslab; i++, p += c->size){
+      *(void**)p = s->free;
+      s->free = p;
+    }
+    partial_push(c, s);
+    c->nslab++;
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  c->nobj++;
+  if(s->free == 0)
+    partial_remove(c, s);
+  return obj;
+}
+
+// Return obj to its slab. Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->free == 0)
+    partial_push(c, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+  c->nobj--;
+  if(s->inuse == 0){
+    partial_remove(c, s);
+    c->nslab--;
+    kfree((void*)s);
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory. The object is not zeroed.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    // refill half the magazine.
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slab_get(c)) != 0)
+      m->objs[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->objs[--m->n] : 0;
+  pop_off();
+  return obj;
+}
+
+// Free an object allocated from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    // flush half the magazine.
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  pop_off();
+}
+
+// Number of pages held by all slab caches.
+int
+slab_pages(void)
+{
+  int i, n = 0;
+
+  for(i = 0; i < ncache; i++){
+    acquire(&caches[i]->lock);
+    n += caches[i]->nslab;
+    release(&caches[i]->lock);
+  }
+  return n;
+}
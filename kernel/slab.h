@@ -0,0 +1,20 @@
+// Object caches for small kernel structures; see slab.c.
+
+#define MAGSIZE 16    // objects each cpu keeps in its magazine
+
+// a per-cpu stack of free objects.
+struct magazine {
+  int n;
+  void *objs[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;              // object size, rounded up to 8 bytes
+  int perslab;            // objects per slab page
+  struct spinlock lock;   // protects the fields below
+  struct slab *partial;   // slabs with at least one free object
+  int nslab;              // slab pages held
+  int nobj;               // objects allocated from slabs
+  struct magazine mag[NCPU];
+};
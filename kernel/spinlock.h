@@ -5,5 +5,9 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For profiling, updated while holding the lock:
+  uint64 nacquire;   // Times acquired.
+  uint64 ncontended; // Times acquire() had to spin.
 };
 
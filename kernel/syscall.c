@@ -107,6 +107,18 @@ extern uint64 sys_uptime(void);
 extern uint64 sys_trace(void);
 extern uint64 sys_set_priority(void);
 extern uint64 sys_waitx(void);
+extern uint64 sys_sched_setpolicy(void);
+extern uint64 sys_setnice(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_nanotime(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_diskstat(void);
+extern uint64 sys_fsync(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -133,6 +145,18 @@ static uint64 (*syscalls[])(void) = {
 [SYS_trace]   sys_trace,
 [SYS_set_priority] sys_set_priority,
 [SYS_waitx]   sys_waitx,
+[SYS_sched_setpolicy] sys_sched_setpolicy,
+[SYS_setnice] sys_setnice,
+[SYS_cpustat] sys_cpustat,
+[SYS_nanotime] sys_nanotime,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_memstat] sys_memstat,
+[SYS_mmap] sys_mmap,
+[SYS_munmap] sys_munmap,
+[SYS_diskstat] sys_diskstat,
+[SYS_fsync] sys_fsync,
 };
 
 char* syscall_number_to_name[] = {
@@ -159,6 +183,19 @@ char* syscall_number_to_name[] = {
 [SYS_close]   "close",
 [SYS_trace]   "trace",
 [SYS_set_priority] "set_priority",
+[SYS_waitx]   "waitx",
+[SYS_sched_setpolicy] "sched_setpolicy",
+[SYS_setnice] "setnice",
+[SYS_cpustat] "cpustat",
+[SYS_nanotime] "nanotime",
+[SYS_nanosleep] "nanosleep",
+[SYS_sched_setaffinity] "sched_setaffinity",
+[SYS_sched_getaffinity] "sched_getaffinity",
+[SYS_memstat] "memstat",
+[SYS_mmap] "mmap",
+[SYS_munmap] "munmap",
+[SYS_diskstat] "diskstat",
+[SYS_fsync] "fsync",
 };
 
 void
@@ -185,19 +222,19 @@ syscall(void)
     {
       int pid=p->pid;
       printf("%d: syscall %s (", pid, syscall_number_to_name[num]);
-      if(num==SYS_getpid || num==SYS_fork || num==SYS_uptime)
+      if(num==SYS_getpid || num==SYS_fork || num==SYS_uptime || num==SYS_nanotime)
       {
         printf(")");
       }
-      if(num==SYS_exit || num==SYS_wait || num==SYS_pipe || num==SYS_kill || num==SYS_chdir || num==SYS_sleep || num==SYS_unlink || num==SYS_dup || num==SYS_mkdir || num==SYS_trace || num==SYS_close || num==SYS_sbrk)
+      if(num==SYS_exit || num==SYS_wait || num==SYS_pipe || num==SYS_kill || num==SYS_chdir || num==SYS_sleep || num==SYS_unlink || num==SYS_dup || num==SYS_mkdir || num==SYS_trace || num==SYS_close || num==SYS_sbrk || num==SYS_nanosleep || num==SYS_sched_getaffinity || num==SYS_memstat || num==SYS_diskstat || num==SYS_fsync)
       {
         printf("%d)", arg1);
       }
-      else if(num==SYS_exec || num==SYS_fstat || num==SYS_link || num==SYS_open || num==SYS_set_priority)
+      else if(num==SYS_exec || num==SYS_fstat || num==SYS_link || num==SYS_open || num==SYS_set_priority || num==SYS_sched_setpolicy || num==SYS_setnice || num==SYS_cpustat || num==SYS_sched_setaffinity || num==SYS_munmap)
       {
       printf("%d %d)", arg1, arg2); 
       }
-      else if(num==SYS_read || num==SYS_write || num==SYS_mknod || num==SYS_waitx)
+      else if(num==SYS_read || num==SYS_write || num==SYS_mknod || num==SYS_waitx || num==SYS_mmap)
       {
       printf("%d %d %d)", arg1, arg2, arg3); 
       }
@@ -22,4 +22,16 @@
 #define SYS_close  21
 #define SYS_trace  22
 #define SYS_set_priority  23
-#define SYS_waitx  24
\ No newline at end of file
+#define SYS_waitx  24
+#define SYS_sched_setpolicy 25
+#define SYS_setnice 26
+#define SYS_cpustat 27
+#define SYS_nanotime 28
+#define SYS_nanosleep 29
+#define SYS_sched_setaffinity 30
+#define SYS_sched_getaffinity 31
+#define SYS_memstat 32
+#define SYS_mmap 33
+#define SYS_munmap 34
+#define SYS_diskstat 35
+#define SYS_fsync 36
\ No newline at end of file
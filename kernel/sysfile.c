@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "diskstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -287,7 +288,7 @@ uint64
 sys_open(void)
 {
   char path[MAXPATH];
-  int fd, omode;
+  int fd, omode, writable;
   struct file *f;
   struct inode *ip;
   int n;
@@ -322,9 +323,24 @@ sys_open(void)
     return -1;
   }
 
+  // a program that some process is running may not be
+  // written or truncated.
+  writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  if(ip->type == T_FILE && (writable || (omode & O_TRUNC))){
+    if(iwriteget(ip) < 0){
+      iunlockput(ip);
+      end_op();
+      return -1;
+    }
+    if(!writable)
+      iwriteput(ip);  // only to truncate, under ip->lock
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
+    if(ip->type == T_FILE && writable)
+      iwriteput(ip);
     iunlockput(ip);
     end_op();
     return -1;
@@ -339,7 +355,7 @@ sys_open(void)
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
-  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->writable = writable;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -484,3 +500,63 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr;
+  int len, prot, flags, off;
+  struct file *f = 0;
+
+  // the address is only a hint, and is ignored.
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if((flags & MAP_ANONYMOUS) == 0 && argfd(4, 0, &f) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+uint64
+sys_diskstat(void)
+{
+  uint64 addr;
+  struct diskstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  virtio_disk_stat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Wait until fd's file, and everything else written so far,
+// is safely on disk.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  log_force();
+  return 0;
+}
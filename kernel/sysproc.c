@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "memstat.h"
 
 uint64
 sys_exit(void)
@@ -83,23 +84,67 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
+  struct timer *t = &myproc()->timer;
 
   if(argint(0, &n) < 0)
     return -1;
+  if(n <= 0)
+    return 0;
   acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
+  timer_add(t, ticks + n, t);
+  while(t->pending){
     if(myproc()->killed){
+      timer_del(t);
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(t, &tickslock);
   }
   release(&tickslock);
   return 0;
 }
 
+// nanoseconds per r_time() cycle.
+#define NSPERCYCLE (1000000000 / TIMEBASE)
+
+// like sys_sleep(), but for ns nanoseconds, using an hrtimer
+// on this cpu rather than the tick-based timer wheel.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+  struct proc *p = myproc();
+  struct hrtimer *t = &p->hrtimer;
+  struct cpu *c;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  if(ns == 0)
+    return 0;
+  push_off();
+  c = mycpu();
+  acquire(&c->hrlock);
+  pop_off();
+  hrtimer_add(t, r_time() + (ns + NSPERCYCLE - 1) / NSPERCYCLE, t);
+  while(t->pending){
+    if(p->killed){
+      hrtimer_del(t);
+      release(&c->hrlock);
+      return -1;
+    }
+    sleep(t, &c->hrlock);
+  }
+  release(&c->hrlock);
+  return 0;
+}
+
+// nanoseconds since boot.
+uint64
+sys_nanotime(void)
+{
+  return r_time() * NSPERCYCLE;
+}
+
 uint64
 sys_kill(void)
 {
@@ -158,4 +203,78 @@ sys_set_priority(void)
   if(return_val<0)
   return -1;
   return static_priority;
-}
\ No newline at end of file
+}
+uint64
+sys_sched_setpolicy(void)
+{
+  int pid, policy;
+
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0)
+    return -1;
+  if(pid < 0)
+    return -1;
+  return sched_setpolicy(pid, policy);
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+    return -1;
+  if(sched_setaffinity(pid, mask) < 0)
+    return -1;
+  // move off this cpu now if it is no longer allowed.
+  if(pid == myproc()->pid)
+    yield();
+  return 0;
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return sched_getaffinity(pid);
+}
+
+uint64
+sys_setnice(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return sched_setnice(pid, nice);
+}
+
+uint64
+sys_cpustat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  return cpustat(addr, n);
+}
+
+uint64
+sys_memstat(void)
+{
+  uint64 addr;
+  struct memstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  kmemstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,145 @@
+// Program text cache.
+//
+// Keeps the pages execfault() reads in from program files, so
+// that every process running the same binary shares one copy
+// of each page, mapped copy-on-write, and exec() of a hot
+// binary needs no disk reads. The cache holds its own
+// reference to each page and keeps at most NTEXT of them,
+// dropping the least recently used one to make room.
+//
+// Pages are hashed by (dev, inum), so all of a file's pages
+// are on one chain, and a write to the file or its truncation
+// drops them. Callers hold the inode's sleep-lock, which keeps
+// a page being read in from racing with a write.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NTEXTHASH 64
+#define THASH(dev, inum) (((dev) * 31 + (inum)) % NTEXTHASH)
+
+struct textpage {
+  uint dev;
+  uint inum;
+  uint off;               // file offset of the page's contents
+  uint n;                 // bytes from the file; the rest is zero
+  void *pa;               // 0 if the entry is free
+  uint lastuse;
+  struct textpage *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct textpage page[NTEXT];
+  struct textpage *hash[NTEXTHASH];
+  uint clock;
+  int npage;
+} tcache;
+
+void
+textinit(void)
+{
+  initlock(&tcache.lock, "tcache");
+}
+
+// Remove t from the cache and drop its page reference.
+// Caller must hold tcache.lock.
+static void
+text_remove(struct textpage *t)
+{
+  struct textpage **pp;
+
+  for(pp = &tcache.hash[THASH(t->dev, t->inum)]; *pp != t; pp = &(*pp)->next)
+    ;
+  *pp = t->next;
+  kfree(t->pa);
+  t->pa = 0;
+  t->next = 0;
+  tcache.npage--;
+}
+
+// Return the cached page holding n bytes of ip from offset
+// off, with a new reference to it, or 0 if there is none.
+void*
+text_get(struct inode *ip, uint off, uint n)
+{
+  struct textpage *t;
+  void *pa = 0;
+
+  acquire(&tcache.lock);
+  for(t = tcache.hash[THASH(ip->dev, ip->inum)]; t; t = t->next){
+    if(t->dev == ip->dev && t->inum == ip->inum && t->off == off && t->n == n){
+      kref(t->pa);
+      t->lastuse = ++tcache.clock;
+      pa = t->pa;
+      break;
+    }
+  }
+  release(&tcache.lock);
+  return pa;
+}
+
+// Add pa, a page holding n bytes of ip from offset off
+// followed by zeroes, to the cache.
+void
+text_put(struct inode *ip, uint off, uint n, void *pa)
+{
+  struct textpage *t, *victim = 0, **bucket;
+
+  acquire(&tcache.lock);
+  for(t = tcache.page; t < &tcache.page[NTEXT]; t++){
+    if(t->pa == 0){
+      victim = t;
+      break;
+    }
+    if(victim == 0 || t->lastuse < victim->lastuse)
+      victim = t;
+  }
+  if(victim->pa)
+    text_remove(victim);
+  victim->dev = ip->dev;
+  victim->inum = ip->inum;
+  victim->off = off;
+  victim->n = n;
+  victim->pa = pa;
+  victim->lastuse = ++tcache.clock;
+  kref(pa);
+  bucket = &tcache.hash[THASH(ip->dev, ip->inum)];
+  victim->next = *bucket;
+  *bucket = victim;
+  tcache.npage++;
+  release(&tcache.lock);
+}
+
+// Drop the cached pages of ip, whose contents are changing.
+void
+text_drop(struct inode *ip)
+{
+  struct textpage *t, *next;
+
+  acquire(&tcache.lock);
+  for(t = tcache.hash[THASH(ip->dev, ip->inum)]; t; t = next){
+    next = t->next;
+    if(t->dev == ip->dev && t->inum == ip->inum)
+      text_remove(t);
+  }
+  release(&tcache.lock);
+}
+
+// Number of pages in the cache.
+int
+text_pages(void)
+{
+  int n;
+
+  acquire(&tcache.lock);
+  n = tcache.npage;
+  release(&tcache.lock);
+  return n;
+}
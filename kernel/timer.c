@@ -0,0 +1,187 @@
+// Hierarchical timer wheel.
+//
+// Pending timers are kept in WHEEL_LEVELS wheels of WHEEL_SIZE
+// slots each. Level 0 has one slot per tick; each slot of level
+// l covers WHEEL_SIZE times as many ticks as a slot of level
+// l-1. When level 0 wraps, the next slot of level 1 is cascaded
+// down, and so on up the levels. So timer_add() and timer_del()
+// are O(1), and each tick only looks at the timers that are
+// about to expire, instead of waking every sleeping process.
+//
+// Everything here is protected by tickslock.
+//
+// For sleeps shorter than a tick there are also hrtimers,
+// which fire at a given r_time() using each hart's one-shot
+// CLINT deadline (see oneshot_set() in trap.c). Each cpu keeps
+// the hrtimers it armed on a list sorted by expiry, protected
+// by c->hrlock, and its one-shot deadline is that of the first.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX    ((1U << (WHEEL_BITS*WHEEL_LEVELS)) - 1)
+
+static struct timer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+// the last tick timer_tick() has handled.
+static uint wheel_now;
+
+static void
+wheel_insert(struct timer *t)
+{
+  uint delta = t->expires - wheel_now;
+  uint e = t->expires;
+  struct timer **slot;
+  int l;
+
+  if(delta > WHEEL_MAX)
+    e = wheel_now + WHEEL_MAX;  // re-inserted when its slot cascades
+  delta = e - wheel_now;
+  for(l = 0; l < WHEEL_LEVELS-1; l++)
+    if(delta < (1U << (WHEEL_BITS*(l+1))))
+      break;
+  slot = &wheel[l][(e >> (WHEEL_BITS*l)) & WHEEL_MASK];
+
+  t->next = *slot;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+// Arrange for wakeup(chan) at tick expires.
+// Caller must hold tickslock.
+void
+timer_add(struct timer *t, uint expires, void *chan)
+{
+  if(t->pending)
+    timer_del(t);
+  if((int)(expires - wheel_now) <= 0)
+    expires = wheel_now + 1;  // already due: fire on the next tick
+  t->expires = expires;
+  t->chan = chan;
+  t->pending = 1;
+  wheel_insert(t);
+}
+
+// Cancel t if it has not fired yet.
+// Caller must hold tickslock.
+void
+timer_del(struct timer *t)
+{
+  if(!t->pending)
+    return;
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+  t->pending = 0;
+}
+
+// Move every timer in slot i of level l to a lower level.
+static void
+cascade(int l, int i)
+{
+  struct timer *t, *next;
+
+  t = wheel[l][i];
+  wheel[l][i] = 0;
+  for(; t; t = next){
+    next = t->next;
+    wheel_insert(t);
+  }
+}
+
+// Called by clockintr() after ticks++, with tickslock held.
+void
+timer_tick(void)
+{
+  struct timer *t;
+  uint i;
+  int l;
+
+  while(wheel_now != ticks){
+    wheel_now++;
+    for(l = 1; l < WHEEL_LEVELS; l++){
+      if(wheel_now & ((1U << (WHEEL_BITS*l)) - 1))
+        break;
+      cascade(l, (wheel_now >> (WHEEL_BITS*l)) & WHEEL_MASK);
+    }
+    i = wheel_now & WHEEL_MASK;
+    while((t = wheel[0][i]) != 0){
+      timer_del(t);
+      wakeup(t->chan);
+    }
+  }
+}
+
+// Arm t to wakeup(chan) at time expires, in r_time() cycles.
+// t goes on this cpu's list; caller must hold mycpu()->hrlock.
+void
+hrtimer_add(struct hrtimer *t, uint64 expires, void *chan)
+{
+  struct cpu *c = mycpu();
+  struct hrtimer **pp;
+
+  t->expires = expires;
+  t->chan = chan;
+  t->pending = 1;
+  t->cpu = c - cpus;
+  for(pp = &c->hrtimers; *pp && (*pp)->expires <= expires; pp = &(*pp)->next)
+    ;
+  t->next = *pp;
+  *pp = t;
+  if(c->hrtimers == t)
+    oneshot_set(expires);
+}
+
+// Cancel t if it has not fired yet. Caller must hold
+// cpus[t->cpu].hrlock. The cpu's one-shot deadline is left
+// alone; if t was first, hrtimer_expire() finds nothing due.
+void
+hrtimer_del(struct hrtimer *t)
+{
+  struct hrtimer **pp;
+
+  if(!t->pending)
+    return;
+  for(pp = &cpus[t->cpu].hrtimers; *pp; pp = &(*pp)->next){
+    if(*pp == t){
+      *pp = t->next;
+      break;
+    }
+  }
+  t->next = 0;
+  t->pending = 0;
+}
+
+// Called by devintr() when this cpu's one-shot deadline
+// has passed.
+void
+hrtimer_expire(void)
+{
+  struct cpu *c = mycpu();
+  struct hrtimer *t;
+  uint64 now;
+
+  acquire(&c->hrlock);
+  now = r_time();
+  while((t = c->hrtimers) != 0 && t->expires <= now){
+    c->hrtimers = t->next;
+    t->next = 0;
+    t->pending = 0;
+    wakeup(t->chan);
+  }
+  oneshot_set(c->hrtimers ? c->hrtimers->expires : ~0ULL);
+  release(&c->hrlock);
+}
@@ -9,6 +9,8 @@
 struct spinlock tickslock;
 uint ticks;
 
+extern uint64 timer_scratch[NCPU][11];  // start.c
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -67,6 +69,19 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault. a store to a copy-on-write page copies it;
+    // otherwise the page may not have been touched yet.
+    // uvmfault() may read it from disk, so turn interrupts
+    // on, once scause and stval are safe in locals.
+    uint64 cause = r_scause(), va = r_stval();
+
+    intr_on();
+    if((cause != 15 || uvmcow(p->pagetable, va) < 0) && uvmfault(p, va) < 0){
+      printf("usertrap(): page fault %p pid=%d\n", cause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      p->killed = 1;
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,23 +91,10 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  #if SCHEDULER != 1 && SCHEDULER != 3
-    // give up the CPU if this is a timer interrupt.
-    if(which_dev == 2)
-      yield();
-  #endif
-
-  #if SCHEDULER==3
-  if(myproc()!=0 && which_dev==2)
-  {
-    int ticks_limit = 1<<(myproc()->curr_queue);
-    if(myproc()->qrtime>=ticks_limit)
-    {
-      set_overshot_proc();
-      yield();
-    }
-  }
-  #endif
+  // give up the CPU if this is a timer interrupt
+  // and p's scheduling class wants to preempt it.
+  if(which_dev == 2 && sched_tick())
+    yield();
 
   usertrapret();
 }
@@ -132,8 +134,9 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // tell trampoline.S the user page table to switch to,
+  // tagged with p's ASID.
+  uint64 satp = uvmsatp(p);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -163,23 +166,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  #if SCHEDULER != 1 && SCHEDULER != 3
-    // give up the CPU if this is a timer interrupt.
-    if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-      yield();
-  #endif
-  
-  #if SCHEDULER==3
-  if(myproc()!=0 && which_dev == 2 && myproc()->state == RUNNING)
-  {
-    int ticks_limit = 1<<(myproc()->curr_queue);
-    if(myproc()->qrtime>=ticks_limit)
-    {
-      set_overshot_proc();
-      yield();
-    }
-  }
-  #endif
+  // give up the CPU if this is a timer interrupt
+  // and the running process's class wants to preempt it.
+  if(which_dev == 2 && sched_tick())
+    yield();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -192,11 +182,7 @@ clockintr()
 {
   acquire(&tickslock);
   ticks++;
-  update_time();
-  #if SCHEDULER == 3
-  update_q_wtime();
-  #endif
-  wakeup(&ticks);
+  timer_tick();
   // GRAPH: Call procdump on every tick
   // procdump();
   release(&tickslock);
@@ -235,20 +221,90 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or from another hart's ipi_send(), forwarded by timervec
+    // in kernelvec.S.
+    int id = cpuid();
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before looking at the tick flag
+    // so that a tick arriving now is not lost.
     w_sip(r_sip() & ~2);
 
+    int oneshot = __sync_lock_test_and_set(&timer_scratch[id][9], 0);
+    int tick = __sync_lock_test_and_set(&timer_scratch[id][5], 0);
+    if(oneshot)
+      hrtimer_expire();
+    if(!tick){
+      if(!oneshot)
+        mycpu()->ipis++;
+      return 1;
+    }
+
+    if(id == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
   }
 }
 
+
+// Interrupt hart id, e.g. to wake it from wfi.
+void
+ipi_send(int id)
+{
+  *(uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Set hart id's CLINT compare register to the earlier of its
+// next tick and its one-shot deadline, as timervec does. If
+// timervec runs in between, the value written can only be
+// too early, and timervec then fixes it up.
+static void
+clint_program(int id)
+{
+  volatile uint64 *s = timer_scratch[id];
+  uint64 next = s[7], oneshot = s[8];
+
+  *(uint64*)CLINT_MTIMECMP(id) = next < oneshot ? next : oneshot;
+}
+
+// Stop this hart's clock interrupts while it idles.
+// Hart 0 keeps ticking, since it maintains ticks.
+void
+tick_stop(void)
+{
+  int id = cpuid();
+
+  if(id != 0){
+    timer_scratch[id][7] = ~0ULL;
+    clint_program(id);
+  }
+}
+
+// Restart the clock interrupts stopped by tick_stop().
+void
+tick_start(void)
+{
+  int id = cpuid();
+
+  if(id != 0){
+    timer_scratch[id][7] = r_time() + timer_scratch[id][4];
+    clint_program(id);
+  }
+}
+
+// Interrupt this hart at time when (in r_time() cycles),
+// or never if when is ~0. hrtimer_expire() is called then.
+// Must be called with interrupts off.
+void
+oneshot_set(uint64 when)
+{
+  int id = cpuid();
+
+  *(volatile uint64*)&timer_scratch[id][8] = when;
+  clint_program(id);
+}
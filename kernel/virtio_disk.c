@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "diskstat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -68,7 +69,19 @@ static struct disk {
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
-  
+
+  // with VIRTIO_RING_F_INDIRECT_DESC, each request takes one
+  // descriptor, which points at a table of its own here: the
+  // header, up to MAXSEG blocks, and the status.
+  // indexed like info[].
+  struct virtq_desc indirect[NUM][MAXSEG+2];
+
+  int nfree;       // free descriptors.
+  int event_idx;   // negotiated VIRTIO_RING_F_EVENT_IDX?
+  int use_indirect; // negotiated VIRTIO_RING_F_INDIRECT_DESC?
+  int inflight;    // requests the device has not finished.
+  struct diskstat stat;
+
   struct spinlock vdisk_lock;
   
 } __attribute__ ((aligned (PGSIZE))) disk;
@@ -100,9 +113,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.event_idx = (features >> VIRTIO_RING_F_EVENT_IDX) & 1;
+  disk.use_indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -136,6 +149,7 @@ virtio_disk_init(void)
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.nfree = NUM;
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
@@ -147,6 +161,7 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
@@ -166,7 +181,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  disk.nfree++;
 }
 
 // free a chain of descriptors.
@@ -184,105 +199,178 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// the spec's vring_need_event(): has an index that the other
+// side asked to hear about once it passes event just moved
+// from old to new?
 static int
-alloc3_desc(int *idx)
+need_event(uint16 event, uint16 new, uint16 old)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
+  return (uint16)(new - event - 1) < (uint16)(new - old);
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// fill in descriptors for a request for the blocks of b and
+// of the bufs linked to it through qnext, which are
+// consecutive, and put it in avail ring slot. caller holds
+// disk.vdisk_lock and has checked that there are enough
+// free descriptors.
+static void
+submit(struct buf *b, int slot)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  struct virtq_desc *d, local[MAXSEG+2];
+  struct buf *s;
+  int head, n, i;
 
-  acquire(&disk.vdisk_lock);
+  for(n = 0, s = b; s; s = s->qnext)
+    n++;
+  head = alloc_desc();
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
-
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  // a descriptor for type/reserved/sector, then the data, then
+  // a 1-byte status result. the data may be in several pieces.
+  struct virtio_blk_req *buf0 = &disk.ops[head];
 
-  if(write)
+  if(b->write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
+  buf0->sector = b->blockno * (BSIZE / 512);
+
+  // build the chain in the request's indirect table, or in
+  // local[] to copy into ring descriptors.
+  d = disk.use_indirect ? disk.indirect[head] : local;
+  d[0].addr = (uint64) buf0;
+  d[0].len = sizeof(struct virtio_blk_req);
+  d[0].flags = VRING_DESC_F_NEXT;
+  for(i = 1, s = b; s; i++, s = s->qnext){
+    d[i].addr = (uint64) s->data;
+    d[i].len = BSIZE;
+    if(b->write)
+      d[i].flags = VRING_DESC_F_NEXT; // device reads s->data
+    else
+      d[i].flags = VRING_DESC_F_NEXT | VRING_DESC_F_WRITE; // device writes s->data
+  }
+  disk.info[head].status = 0xff; // device writes 0 on success
+  d[i].addr = (uint64) &disk.info[head].status;
+  d[i].len = 1;
+  d[i].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[i].next = 0;
+
+  if(disk.use_indirect){
+    for(i = 0; i < n+1; i++)
+      d[i].next = i+1;
+    disk.desc[head].addr = (uint64) d;
+    disk.desc[head].len = (n+2) * sizeof(struct virtq_desc);
+    disk.desc[head].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[head].next = 0;
+  } else {
+    int idx = head, nxt;
+    for(i = 0; i < n+2; i++){
+      nxt = i < n+1 ? alloc_desc() : 0;
+      disk.desc[idx] = d[i];
+      disk.desc[idx].next = nxt;
+      idx = nxt;
+    }
+  }
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  // record struct buf for virtio_disk_intr().
+  disk.info[head].b = b;
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+  if(b->write)
+    disk.stat.nwrite++;
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
-
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+    disk.stat.nread++;
+  disk.stat.nmerged += n - 1;
+  if(++disk.inflight > disk.stat.maxinflight)
+    disk.stat.maxinflight = disk.inflight;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[slot % NUM] = head;
+}
+
+// send requests from the I/O scheduler to the device for as
+// long as there are descriptors for them. caller holds
+// disk.vdisk_lock.
+static void
+dispatch(void)
+{
+  struct buf *b;
+  uint16 old = disk.avail->idx;
+  int n = 0;
+
+  while(disk.nfree >= (disk.use_indirect ? 1 : MAXSEG+2) &&
+        (b = iosched_next()) != 0){
+    submit(b, old + n);
+    n++;
+  }
+  if(n == 0)
+    return;
 
   __sync_synchronize();
 
-  // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  // tell the device more avail ring entries are available.
+  disk.avail->idx = old + n; // not % NUM ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  // with EVENT_IDX, a device that is still working through
+  // earlier requests needn't be told; it will find these.
+  if(!disk.event_idx || need_event(disk.used->avail_event, old + n, old)){
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    disk.stat.nnotify++;
+  }
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// queue b's I/O for the disk, without waiting. when the I/O
+// finishes, virtio_disk_intr() calls b->done(b) if it is set;
+// otherwise the caller must virtio_disk_wait(b) before
+// touching b again. queued requests stay with the I/O
+// scheduler, where later ones may be merged with them, until
+// virtio_disk_wait() or virtio_disk_unplug().
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  b->disk = 1;
+  b->write = write;
+  iosched_add(b);
+  release(&disk.vdisk_lock);
+}
+
+// send the queued requests to the device.
+void
+virtio_disk_unplug(void)
+{
+  acquire(&disk.vdisk_lock);
+  dispatch();
+  release(&disk.vdisk_lock);
+}
+
+// send the queued requests to the device, and wait for
+// b's I/O to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  dispatch();
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
   acquire(&disk.vdisk_lock);
+  disk.stat.nintr++;
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -297,19 +385,53 @@ virtio_disk_intr()
   // the device increments disk.used->idx when it
   // adds an entry to the used ring.
 
-  while(disk.used_idx != disk.used->idx){
+  for(;;){
+    while(disk.used_idx != disk.used->idx){
+      __sync_synchronize();
+      int id = disk.used->ring[disk.used_idx % NUM].id;
+
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      struct buf *b = disk.info[id].b, *next;
+      disk.info[id].b = 0;
+      free_chain(id);
+      disk.inflight--;
+      for(; b; b = next){
+        next = b->qnext;
+        b->qnext = 0;
+        b->disk = 0;   // disk is done with buf
+        if(b->done)
+          b->done(b);  // no one is waiting; finish it here.
+        else
+          wakeup(b);
+      }
+
+      disk.used_idx += 1;
+    }
+    if(!disk.event_idx)
+      break;
+    // with EVENT_IDX, ask for an interrupt when the next
+    // request finishes, but not for any more after it until
+    // we get here again. then look again, in case one
+    // finished before the device could see that.
+    disk.avail->used_event = disk.used_idx;
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
-
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+    if(disk.used_idx == disk.used->idx)
+      break;
+  }
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+  // the finished requests' descriptors can take more.
+  dispatch();
 
-    disk.used_idx += 1;
-  }
+  release(&disk.vdisk_lock);
+}
 
+// Fill in driver statistics for the diskstat() system call.
+void
+virtio_disk_stat(struct diskstat *st)
+{
+  acquire(&disk.vdisk_lock);
+  *st = disk.stat;
   release(&disk.vdisk_lock);
 }
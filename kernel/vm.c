@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,6 +17,18 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// Address-space identifiers. Each process's page table is
+// tagged with an ASID in satp, so that entering and leaving
+// the kernel need not flush the TLB; the kernel's is 0. A
+// process's ASID holds the generation it was handed out in
+// above the low ASIDBITS bits. When a generation runs out,
+// every process takes a new ASID from the next, and each cpu
+// flushes its whole TLB before it uses any of them.
+static struct spinlock asid_lock;
+static uint64 asid_max;                   // 0 if no ASID support
+static uint64 asid_gen = 1L << ASIDBITS;  // current generation
+static uint64 asid_next = 1;              // next ASID to hand out
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -30,6 +44,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so that harts can interrupt each other (see ipi_send()).
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -61,13 +78,119 @@ kvminit(void)
 void
 kvminithart()
 {
+  if(cpuid() == 0){
+    // find out how many ASID bits the hardware has, by
+    // writing ones to them and seeing which stick.
+    w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(ASIDMASK));
+    asid_max = SATP2ASID(r_satp());
+    initlock(&asid_lock, "asid");
+  }
   w_satp(MAKE_SATP(kernel_pagetable));
   sfence_vma();
 }
 
+// Give p a fresh ASID from the current generation, starting
+// a new generation if they have run out.
+static void
+asid_new(struct proc *p)
+{
+  acquire(&asid_lock);
+  if(asid_next > asid_max){
+    asid_gen += 1L << ASIDBITS;
+    asid_next = 1;
+  }
+  p->asid = asid_gen | asid_next++;
+  p->tlbstale = 0;
+  release(&asid_lock);
+}
+
+// Return the satp value that switches to p's page table, after
+// flushing anything stale for it from this cpu's TLB. Called by
+// usertrapret() with interrupts off.
+uint64
+uvmsatp(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 bit = 1L << cpuid();
+
+  if(asid_max == 0)
+    return MAKE_SATP(p->pagetable);  // userret flushes everything
+  if((p->asid & ~ASIDMASK) != asid_gen)
+    asid_new(p);
+  if(c->asid_gen != (p->asid & ~ASIDMASK)){
+    // ASIDs have been handed out again since this cpu last
+    // flushed, so any of its entries may be another's.
+    sfence_vma();
+    c->asid_gen = p->asid & ~ASIDMASK;
+    p->tlbstale &= ~bit;
+  }
+  if(p->tlbstale & bit){
+    sfence_vma_asid(p->asid & ASIDMASK);
+    p->tlbstale &= ~bit;
+  }
+  return MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
+}
+
+// Note that a PTE of the current process's page table may have
+// changed. Its ASID's TLB entries on every cpu are suspect until
+// uvmsatp() flushes them there. Over-marking, as when exec builds
+// a new page table, only costs a flush.
+static void
+pte_changed(void)
+{
+  struct proc *p = myproc();
+
+  if(p)
+    p->tlbstale = ~0L;
+}
+
+// Return the address of the level-1 PTE for va, which maps
+// a megapage if it is a leaf. If alloc!=0, create the level-1
+// page-table page if need be.
+static pte_t *
+walkmega(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    panic("walkmega");
+
+  pte = &pagetable[PX(2, va)];
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      return 0;
+    memset(pagetable, 0, PGSIZE);
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  return &pagetable[PX(1, va)];
+}
+
+// Replace the megapage leaf PTE pte by a page table of 512
+// PTEs for its 4096-byte pages, with the same flags. Each of
+// those pages has its own reference count already, so the
+// counts don't change. Returns 0, or -1 if out of memory.
+static int
+megasplit(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa = PTE2PA(*pte);
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | PTE_FLAGS(*pte);
+  *pte = PA2PTE(pt) | PTE_V;
+  pte_changed();
+  return 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page-table pages.
+// create any required page-table pages. If va is in a
+// megapage, split it first, so the PTE always maps a
+// 4096-byte page; walkleaf() looks without splitting.
 //
 // The risc-v Sv39 scheme has three levels of page-table
 // pages. A page-table page contains 512 64-bit PTEs.
@@ -77,6 +200,7 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+// A leaf PTE at level 1 maps a 2-megabyte megapage.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -86,6 +210,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte) && megasplit(pte) < 0)
+        return 0;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
@@ -97,19 +223,37 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
-// Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// Like walk(pagetable, va, 0), but if va is in a megapage,
+// return its level-1 PTE without splitting it, and set *mega.
+pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *mega)
+{
+  pte_t *pte;
+
+  *mega = 0;
+  if((pte = walkmega(pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+    return 0;
+  if(PTE_LEAF(*pte)){
+    *mega = 1;
+    return pte;
+  }
+  return &((pagetable_t)PTE2PA(*pte))[PX(0, va)];
+}
+
+// Look up a virtual address, return the physical address
+// of its page, or 0 if not mapped.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int mega;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &mega);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
@@ -117,6 +261,24 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(mega)
+    pa += PGROUNDDOWN(va % MEGASIZE);
+  return pa;
+}
+
+// Like walkaddr(), but if va is a page of the current
+// process that has not been touched yet, fault it in.
+// For the copyin/copyout family.
+static uint64
+uwalkaddr(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  pa = walkaddr(pagetable, va);
+  if(pa == 0 && p != 0 && p->pagetable == pagetable &&
+     uvmfault(p, va) == 0)
+    pa = walkaddr(pagetable, va);
   return pa;
 }
 
@@ -132,8 +294,10 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
+// be page-aligned. Where va and pa are both aligned to
+// MEGASIZE, at least MEGASIZE bytes remain, and nothing is
+// mapped there yet, use a megapage. Returns 0 on success, -1
+// if walk() couldn't allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
@@ -142,10 +306,20 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 
   if(size == 0)
     panic("mappages: size");
+  pte_changed();
   
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
+    if((a % MEGASIZE) == 0 && (pa % MEGASIZE) == 0 && last - a >= MEGASIZE - PGSIZE &&
+       (pte = walkmega(pagetable, a, 1)) != 0 && (*pte & PTE_V) == 0){
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      if(last - a == MEGASIZE - PGSIZE)
+        break;
+      a += MEGASIZE;
+      pa += MEGASIZE;
+      continue;
+    }
     if((pte = walk(pagetable, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
@@ -159,23 +333,57 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// If a is inside a megapage rather than at its start, split
+// the megapage, so that a range starting or ending at a covers
+// only whole leaves. Returns 0, or -1 if out of memory.
+static int
+megaedge(pagetable_t pagetable, uint64 a)
+{
+  pte_t *pte;
+  int mega;
+
+  if((a % MEGASIZE) == 0 || a >= MAXVA)
+    return 0;
+  if((pte = walkleaf(pagetable, a, &mega)) == 0 || !mega)
+    return 0;
+  return megasplit(pte);
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
-void
+// Returns 0, or -1 if a megapage that the range only partly
+// covers could not be split, in which case nothing is unmapped.
+// A range that covers its megapages whole cannot fail.
+int
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end = va + npages*PGSIZE;
   pte_t *pte;
+  int mega;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
+  if(megaedge(pagetable, va) < 0 || megaedge(pagetable, end) < 0)
+    return -1;
+  pte_changed();
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+  for(a = va; a < end; a += PGSIZE){
+    if((pte = walkleaf(pagetable, a, &mega)) == 0)
+      continue;  // never touched; see uvmlazy()
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
+    if(mega){
+      // megaedge() split any megapage not wholly in range.
+      if((a % MEGASIZE) != 0 || end - a < MEGASIZE)
+        panic("uvmunmap: megapage");
+      if(do_free)
+        for(uint64 off = 0; off < MEGASIZE; off += PGSIZE)
+          kfree((void*)(PTE2PA(*pte) + off));
+      *pte = 0;
+      a += MEGASIZE - PGSIZE;
+      continue;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -184,6 +392,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  return 0;
 }
 
 // create an empty user page table.
@@ -246,7 +455,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or oldsz if
+// out of memory.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
@@ -255,7 +465,8 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    if(uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1) < 0)
+      return oldsz;
   }
 
   return newsz;
@@ -300,25 +511,14 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i;
-  uint flags;
-  char *mem;
+  uint64 i;
+  int n;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+  // share each page, read-only in both, and copy it
+  // only when one of them writes to it.
+  for(i = 0; i < sz; i += n){
+    if((n = uvmshare(old, new, i, 1)) < 0)
       goto err;
-    }
   }
   return 0;
 
@@ -327,6 +527,175 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Map the page of old at va, or the whole megapage if va is
+// the start of one, into new as well, for fork(). If cow, a
+// writable page becomes copy-on-write in both. Returns the
+// number of bytes done, which is PGSIZE if va is not mapped,
+// or -1 if out of memory.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 va, int cow)
+{
+  pte_t *pte;
+  uint64 pa, off;
+  int mega, n;
+
+  if((pte = walkleaf(old, va, &mega)) == 0 || (*pte & PTE_V) == 0)
+    return PGSIZE;  // never touched; see uvmlazy()
+  if(mega && (va % MEGASIZE) != 0)
+    panic("uvmshare: megapage");
+  n = mega ? MEGASIZE : PGSIZE;
+  if(cow && (*pte & PTE_W)){
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+    pte_changed();
+  }
+  pa = PTE2PA(*pte);
+  // the child has nothing to write back yet.
+  if(mappages(new, va, n, pa, PTE_FLAGS(*pte) & ~PTE_D) != 0)
+    return -1;
+  for(off = 0; off < n; off += PGSIZE)
+    kref((void*)(pa + off));
+  return n;
+}
+
+// Map a zeroed megapage over the MEGASIZE-aligned block
+// holding va, if the block lies within [lo, hi) and none of
+// it is mapped yet. Returns 0 on success, else -1, and the
+// caller should map a single page instead.
+int
+uvmmega(pagetable_t pagetable, uint64 va, uint64 lo, uint64 hi, int perm)
+{
+  uint64 a = va - va % MEGASIZE;
+  pte_t *pte;
+  char *mem;
+
+  if(a < lo || a + MEGASIZE > hi || a + MEGASIZE > MAXVA)
+    return -1;
+  if((pte = walkmega(pagetable, a, 0)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc_order(MEGAORDER)) == 0)
+    return -1;
+  memset(mem, 0, MEGASIZE);
+  if(mappages(pagetable, a, MEGASIZE, (uint64)mem, perm) != 0){
+    kfree_order(mem, MEGAORDER);
+    return -1;
+  }
+  return 0;
+}
+
+// Allocate a zeroed page for va, the first time a process
+// touches it. sbrk() only moves p->sz, so the pages of the
+// heap below sz are allocated here, on demand. The heap gets
+// no megapages: a sparse heap would pay 2 MB for each page
+// it touches.
+// Returns 0 on success, -1 if va is outside the process's
+// memory, already mapped, or there is no memory.
+int
+uvmlazy(pagetable_t pagetable, uint64 va, uint64 sz)
+{
+  pte_t *pte;
+  char *mem;
+  int mega;
+
+  if(va >= sz || va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walkleaf(pagetable, va, &mega)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in the page of p at va, which is not mapped yet:
+// read it from the program file if it is in one of the
+// program's segments, fill it in from its mapping if it is
+// mmap()ed, else zero-fill it if it is below p->sz.
+// Reading a file may sleep and takes the file's inode
+// lock, so it is only done with interrupts on, i.e. when no
+// spin lock is held; callers that copy to or from user memory
+// while holding a spin lock or an inode lock use
+// uvmprefault() first.
+// Returns 0 on success, -1 on failure.
+int
+uvmfault(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  if(execseg(p, va) != 0)
+    return intr_get() ? execfault(p, va) : -1;
+  if((v = vma_find(p, va)) != 0)
+    return v->f == 0 || intr_get() ? vmafault(p, va) : -1;
+  return uvmlazy(p->pagetable, va, p->sz);
+}
+
+// Fault in the file-backed pages of the current process in
+// [va, va+len), from its program or mapped files, so that
+// they can be copied to or from while holding a lock. Other
+// pages need no help.
+void
+uvmprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct seg *s;
+  struct vma *v;
+  uint64 a;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    a = PGROUNDDOWN(va) > s->va ? PGROUNDDOWN(va) : s->va;
+    for(; a < va + len && a < s->va + s->memsz; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0)
+        execfault(p, a);
+  }
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0 || v->f == 0)
+      continue;
+    a = PGROUNDDOWN(va) > v->addr ? PGROUNDDOWN(va) : v->addr;
+    for(; a < va + len && a < v->addr + v->len; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0)
+        vmafault(p, a);
+  }
+}
+
+// Give the copy-on-write page at va a private, writable
+// copy, after a write to it. If no other page table shares
+// the page any more, it is simply made writable again.
+// Returns 0 on success, -1 if va is not a copy-on-write
+// page or there is no memory.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  pte_changed();
+  if(krefcount((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -338,6 +707,7 @@ uvmclear(pagetable_t pagetable, uint64 va)
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
+  pte_changed();
 }
 
 // Copy from kernel to user.
@@ -347,12 +717,26 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
+  int mega;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
+    pte = walkleaf(pagetable, va0, &mega);
+    if((*pte & (PTE_W|PTE_COW)) == 0)
+      return -1;  // mapped read-only, e.g. mmap(PROT_READ)
+    if(*pte & PTE_COW){
+      if(uvmcow(pagetable, va0) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+      pte = walkleaf(pagetable, va0, &mega);
+    }
+    // the write goes through the direct map, so mark the page
+    // dirty for vma_writeback() as a user store would.
+    *pte |= PTE_A|PTE_D;
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -375,7 +759,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -402,7 +786,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,80 @@
+// Cache-warmth benchmark for cpu affinity.
+// Starts two workers per cpu, each repeatedly summing its own
+// WSSIZE-byte working set for NTICKS ticks, and reports the
+// total number of passes. Runs once with the workers free to
+// move between cpus and once with each pinned to one cpu.
+// Pinned workers keep their working set warm in that hart's
+// cache; note that qemu's TCG does not model caches, so the
+// difference shows up on real hardware or under KVM.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+#define NTICKS 30
+#define WSSIZE (16*1024)
+
+struct cpustat st[NCPU];
+
+int
+worker(uint end)
+{
+  static char buf[WSSIZE];
+  uint sum = 0;
+  int i, passes = 0;
+
+  for(i = 0; i < WSSIZE; i++)
+    buf[i] = i;
+  while(uptime() < end){
+    for(i = 0; i < WSSIZE; i += 64)
+      sum += buf[i];
+    passes++;
+  }
+  return sum == 0xffffffff ? 0 : passes;  // keep sum live
+}
+
+int
+run(int ncpu, int pinned)
+{
+  int i, pid, status, total = 0;
+  uint end = uptime() + NTICKS;
+
+  for(i = 0; i < 2*ncpu; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("affinitybench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(pinned && sched_setaffinity(getpid(), 1ULL << (i % ncpu)) < 0){
+        printf("affinitybench: sched_setaffinity failed\n");
+        exit(0);
+      }
+      exit(worker(end));
+    }
+  }
+  for(i = 0; i < 2*ncpu; i++)
+    if(wait(&status) >= 0)
+      total += status;
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, ncpu = 0;
+
+  n = cpustat(st, NCPU);
+  for(i = 0; i < n; i++)
+    if(st[i].uptime)
+      ncpu++;
+  if(ncpu == 0)
+    ncpu = 1;
+
+  printf("%d cpus, %d workers\n", ncpu, 2*ncpu);
+  printf("unpinned\t%d passes\n", run(ncpu, 0));
+  printf("pinned\t\t%d passes\n", run(ncpu, 1));
+  exit(0);
+}
@@ -0,0 +1,85 @@
+// Page allocator scaling benchmark.
+// For 1, 2, 4 and 8 harts (as many as are running), starts one
+// worker pinned to each hart. Each worker grows and shrinks its
+// heap with sbrk() and forks short-lived children, which keeps
+// kalloc() and kfree() busy, for NTICKS ticks. Reports pages
+// allocated per second and how often an allocator lock was
+// found held, from memstat().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define NTICKS 20
+#define NPAGES 16     // pages per sbrk() call
+#define FORKEVERY 8   // sbrk rounds per fork
+
+struct cpustat cst[NCPU];
+
+void
+worker(uint end)
+{
+  char *p;
+  int i, round = 0;
+
+  while(uptime() < end){
+    p = sbrk(NPAGES * 4096);
+    if(p == (char*)-1)
+      exit(1);
+    for(i = 0; i < NPAGES; i++)
+      p[i * 4096] = i;
+    sbrk(-NPAGES * 4096);
+    if(++round % FORKEVERY == 0){
+      int pid = fork();
+      if(pid == 0)
+        exit(0);
+      if(pid > 0)
+        wait(0);
+    }
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat m0, m1;
+  uint64 t0, t1, pages;
+  int i, n, nharts, ncpu = 0;
+
+  n = cpustat(cst, NCPU);
+  for(i = 0; i < n; i++)
+    if(cst[i].uptime)
+      ncpu++;
+
+  printf("harts\tpages/s\t\tcontended/acquires\n");
+  for(nharts = 1; nharts <= 8 && nharts <= ncpu; nharts *= 2){
+    uint end = uptime() + NTICKS;
+    memstat(&m0);
+    t0 = nanotime();
+    for(i = 0; i < nharts; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("allocbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        if(sched_setaffinity(getpid(), 1ULL << i) < 0)
+          printf("allocbench: cannot pin to cpu %d\n", i);
+        worker(end);
+      }
+    }
+    for(i = 0; i < nharts; i++)
+      wait(0);
+    t1 = nanotime();
+    memstat(&m1);
+    pages = m1.nalloc - m0.nalloc;
+    printf("%d\t%d\t\t%d/%d\n", nharts, (int)(pages * 1000000000ULL / (t1 - t0)),
+           (int)(m1.lock_contended - m0.lock_contended),
+           (int)(m1.lock_acquires - m0.lock_acquires));
+  }
+  exit(0);
+}
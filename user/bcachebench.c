@@ -0,0 +1,91 @@
+// Buffer cache benchmark.
+// Each of nproc processes reads its own small file over and
+// over for NTICKS ticks. The files fit in the buffer cache, so
+// every read() is one cache lookup and a copy, and the rate
+// shows how well lookups by different processes run in
+// parallel. Run with CPUS > 1.
+// Usage: bcachebench [nproc]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NBLOCK 12     // direct blocks only, so no indirect lookups
+#define NTICKS 20
+
+char buf[BSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, i, fd, n, total = 0;
+  int fds[2];
+  char path[] = "bcbench0";
+  uint start, end;
+  uint64 t0, t1;
+
+  nproc = argc > 1 ? atoi(argv[1]) : NCHILD;
+  if(nproc <= 0 || nproc > 10){
+    fprintf(2, "usage: bcachebench [nproc]\n");
+    exit(1);
+  }
+  memset(buf, 'b', sizeof(buf));
+  for(i = 0; i < nproc; i++){
+    path[7] = '0' + i;
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      fprintf(2, "bcachebench: create %s failed\n", path);
+      exit(1);
+    }
+    for(n = 0; n < NBLOCK; n++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+  }
+  if(pipe(fds) < 0){
+    fprintf(2, "bcachebench: pipe failed\n");
+    exit(1);
+  }
+
+  start = uptime();
+  while(uptime() == start)
+    ;
+  start = uptime();
+  end = start + NTICKS;
+  t0 = nanotime();
+  for(i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "bcachebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      path[7] = '0' + i;
+      n = 0;
+      while(uptime() < end){
+        if((fd = open(path, O_RDONLY)) < 0)
+          exit(1);
+        while(read(fd, buf, sizeof(buf)) == sizeof(buf))
+          n++;
+        close(fd);
+      }
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  while(read(fds[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  t1 = nanotime();
+  for(i = 0; i < nproc; i++)
+    wait(0);
+
+  for(i = 0; i < nproc; i++){
+    path[7] = '0' + i;
+    unlink(path);
+  }
+  printf("%d processes: %d block lookups, %d per second\n",
+         nproc, total, (int)(total * 1000000000ULL / (t1 - t0)));
+  exit(0);
+}
@@ -0,0 +1,79 @@
+// CFS fairness benchmark.
+// Runs NCHILD CPU-bound processes under CFS, half at nice 0
+// (weight 1024) and half at nice 5 (weight 335), for NTICKS
+// ticks, and checks that the CPU time each group received is
+// within TOLERANCE percent of its share of the total weight.
+// Run with `make qemu CPUS=1` for the tightest numbers; with
+// more harts the groups are also balanced across run queues.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+#define NCHILD 32
+#define NTICKS 200
+#define TOLERANCE 10
+
+int nices[2] = { 0, 5 };
+int weights[2] = { 1024, 335 };
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, status, wtime, rtime;
+  int group[NCHILD], pids[NCHILD];
+  int rt[2] = { 0, 0 };
+  int total, expect, got, fail = 0;
+  uint end;
+
+  if(sched_setpolicy(getpid(), SCHED_CFS) < 0){
+    printf("cfsbench: sched_setpolicy failed\n");
+    exit(1);
+  }
+
+  end = uptime() + NTICKS;
+  for(i = 0; i < NCHILD; i++){
+    group[i] = i % 2;
+    pid = fork();
+    if(pid < 0){
+      printf("cfsbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(setnice(getpid(), nices[group[i]]) < 0){
+        printf("cfsbench: setnice failed\n");
+        exit(1);
+      }
+      while(uptime() < end)
+        ;
+      exit(0);
+    }
+    pids[i] = pid;
+  }
+
+  for(;;){
+    pid = waitx(&status, &wtime, &rtime);
+    if(pid < 0)
+      break;
+    for(i = 0; i < NCHILD; i++)
+      if(pids[i] == pid)
+        rt[group[i]] += rtime;
+  }
+
+  total = rt[0] + rt[1];
+  if(total == 0){
+    printf("cfsbench: no run time recorded\n");
+    exit(1);
+  }
+  printf("nice\tweight\trtime\tshare\texpected\n");
+  for(i = 0; i < 2; i++){
+    got = rt[i] * 100 / total;
+    expect = weights[i] * 100 / (weights[0] + weights[1]);
+    printf("%d\t%d\t%d\t%d%%\t%d%%\n", nices[i], weights[i], rt[i], got, expect);
+    if(got < expect - TOLERANCE || got > expect + TOLERANCE)
+      fail = 1;
+  }
+  printf(fail ? "cfsbench: FAIL\n" : "cfsbench: OK\n");
+  exit(fail);
+}
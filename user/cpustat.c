@@ -0,0 +1,54 @@
+// Show how busy each cpu was while a command ran.
+// Usage: cpustat [command args...]
+// With no command, measures NTICKS ticks of whatever
+// else is running.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+#define NTICKS 10
+
+struct cpustat before[NCPU], after[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid;
+  uint64 up, idle;
+
+  if((n = cpustat(before, NCPU)) < 0){
+    fprintf(2, "cpustat: cpustat failed\n");
+    exit(1);
+  }
+  if(argc > 1){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "cpustat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "cpustat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else {
+    sleep(NTICKS);
+  }
+  cpustat(after, n);
+
+  printf("cpu\tidle%%\twakeups\tipis\n");
+  for(i = 0; i < n; i++){
+    if(after[i].uptime == 0)
+      continue;
+    up = after[i].uptime - before[i].uptime;
+    idle = after[i].idle - before[i].idle;
+    printf("%d\t%d\t%d\t%d\n", i, up ? (int)(idle * 100 / up) : 0,
+           (int)(after[i].wakeups - before[i].wakeups),
+           (int)(after[i].ipis - before[i].ipis));
+  }
+  exit(0);
+}
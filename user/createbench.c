@@ -0,0 +1,67 @@
+// Small-file create benchmark.
+// Creates, writes and closes nfiles small files, then unlinks
+// them, and reports files per second. Then does it again with
+// an fsync() after each write, which waits for the log to
+// commit every file, as a program that needs each one to be
+// durable would have to.
+// Usage: createbench [nfiles]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NFILES 100
+
+char data[512];
+
+static void
+run(int nfiles, int sync)
+{
+  char path[] = "cb000";
+  int i, fd;
+  uint64 t0, dt;
+
+  t0 = nanotime();
+  for(i = 0; i < nfiles; i++){
+    path[2] = '0' + i / 100;
+    path[3] = '0' + i / 10 % 10;
+    path[4] = '0' + i % 10;
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      fprintf(2, "createbench: create %s failed\n", path);
+      exit(1);
+    }
+    write(fd, data, sizeof(data));
+    if(sync && fsync(fd) < 0){
+      fprintf(2, "createbench: fsync failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < nfiles; i++){
+    path[2] = '0' + i / 100;
+    path[3] = '0' + i / 10 % 10;
+    path[4] = '0' + i % 10;
+    unlink(path);
+  }
+  dt = nanotime() - t0;
+  printf("%s: %d files in %d ms, %d per second\n",
+         sync ? "with fsync" : "no fsync", nfiles, (int)(dt / 1000000),
+         (int)(nfiles * 1000000000ULL / dt));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles;
+
+  nfiles = argc > 1 ? atoi(argv[1]) : NFILES;
+  if(nfiles <= 0 || nfiles > 999){
+    fprintf(2, "usage: createbench [nfiles]\n");
+    exit(1);
+  }
+  memset(data, 'c', sizeof(data));
+  run(nfiles, 0);
+  run(nfiles, 1);
+  exit(0);
+}
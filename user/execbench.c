@@ -0,0 +1,59 @@
+// Exec latency benchmark.
+// Times NITER rounds of fork+exec+wait for a small and a
+// large program, each run with a bad argument so that it
+// exits at once, and prints the size of each binary next
+// to its average time. With demand paging the time should
+// hardly depend on the size.
+// Usage: execbench [prog ...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NITER 20
+
+char *defaults[] = { "echo", "forkbench", "usertests" };
+
+int
+main(int argc, char *argv[])
+{
+  char **progs = defaults, *args[3];
+  int i, j, pid, n = sizeof(defaults)/sizeof(defaults[0]);
+  uint64 t0, total;
+  struct stat st;
+
+  if(argc > 1){
+    progs = argv + 1;
+    n = argc - 1;
+  }
+  printf("program\t\tbytes\texec(us)\n");
+  for(i = 0; i < n; i++){
+    if(stat(progs[i], &st) < 0){
+      fprintf(2, "execbench: cannot stat %s\n", progs[i]);
+      continue;
+    }
+    args[0] = progs[i];
+    args[1] = "-x";
+    args[2] = 0;
+    total = 0;
+    for(j = 0; j < NITER; j++){
+      t0 = nanotime();
+      pid = fork();
+      if(pid < 0){
+        fprintf(2, "execbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        // keep the program's output off the results.
+        close(1);
+        close(2);
+        exec(args[0], args);
+        exit(1);
+      }
+      wait(0);
+      total += nanotime() - t0;
+    }
+    printf("%s\t%d\t%d\n", progs[i], st.size, (int)(total / NITER / 1000));
+  }
+  exit(0);
+}
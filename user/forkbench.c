@@ -0,0 +1,73 @@
+// Fork latency benchmark.
+// Grows the heap by HEAPMB megabytes and touches every page,
+// then NITER times forks a child that exec()s this program
+// again (which exits at once), and reports the average
+// fork+exec+wait time. Before exec, each child reports how
+// many pages the fork cost, from memstat().
+// Usage: forkbench [heap-mb]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define HEAPMB 8
+#define NITER  20
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  uint64 before, t0, total = 0;
+  long used, peak = 0;
+  int i, mb, pid, p[2];
+  char *heap, *args[] = { argv[0], "-x", 0 };
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  mb = argc > 1 ? atoi(argv[1]) : HEAPMB;
+  if(mb <= 0){
+    fprintf(2, "usage: forkbench [heap-mb]\n");
+    exit(1);
+  }
+  if((heap = sbrk(mb << 20)) == (char*)-1){
+    fprintf(2, "forkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < mb << 20; i += 4096)
+    heap[i] = i;
+
+  for(i = 0; i < NITER; i++){
+    if(pipe(p) < 0 || memstat(&st) < 0){
+      fprintf(2, "forkbench: pipe or memstat failed\n");
+      exit(1);
+    }
+    before = st.nfree;
+    t0 = nanotime();
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      used = 0;
+      if(memstat(&st) == 0)
+        used = before - st.nfree;
+      write(p[1], &used, sizeof(used));
+      exec(args[0], args);
+      fprintf(2, "forkbench: exec failed\n");
+      exit(1);
+    }
+    wait(0);
+    total += nanotime() - t0;
+    if(read(p[0], &used, sizeof(used)) == sizeof(used) && used > peak)
+      peak = used;
+    close(p[0]);
+    close(p[1]);
+  }
+
+  printf("heap %d MB: fork+exec+wait %d us, fork used %d pages\n",
+         mb, (int)(total / NITER / 1000), (int)peak);
+  exit(0);
+}
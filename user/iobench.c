@@ -0,0 +1,146 @@
+// Disk I/O benchmark.
+// Creates, writes and removes NFILES small files, writes one
+// large file, and reads a large file that is not in the
+// buffer cache, and reports for each phase how many requests
+// the disk driver issued, how many blocks the I/O scheduler
+// merged into other blocks' requests, how often the driver
+// had to notify the device and take an interrupt, and how
+// many requests were in flight at most, from diskstat().
+// Each write phase ends with fsync(), so that its log commit
+// is counted in it.
+//
+// The file it just wrote is still in the buffer cache, so the
+// read phase reads a program instead, by default the largest.
+// Only the first run since boot reads it from the disk, and
+// readbench reads the same file, so run iobench first.
+// Usage: iobench [nfiles [file]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/diskstat.h"
+#include "user/user.h"
+
+#define NFILES 50
+#define NBIG   200   // blocks in the large file
+
+char buf[BSIZE];
+struct diskstat st0;
+
+static void
+begin(void)
+{
+  if(diskstat(&st0) < 0){
+    fprintf(2, "iobench: diskstat failed\n");
+    exit(1);
+  }
+}
+
+// Wait until everything written so far is on the disk.
+static void
+flush(void)
+{
+  int fd;
+
+  if((fd = open("/", O_RDONLY)) < 0 || fsync(fd) < 0){
+    fprintf(2, "iobench: fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+}
+
+static void
+report(char *what, int nops, uint64 t0)
+{
+  struct diskstat st;
+  uint64 dt = nanotime() - t0;
+  int nreq;
+
+  diskstat(&st);
+  nreq = (int)(st.nread - st0.nread + st.nwrite - st0.nwrite);
+  printf("%s: %d ops in %d ms\n", what, nops, (int)(dt / 1000000));
+  printf("  %d reads, %d writes, %d/100 requests per op\n",
+         (int)(st.nread - st0.nread), (int)(st.nwrite - st0.nwrite),
+         nreq * 100 / nops);
+  printf("  %d blocks merged into other requests\n",
+         (int)(st.nmerged - st0.nmerged));
+  printf("  %d notifies, %d interrupts, %d most in flight\n",
+         (int)(st.nnotify - st0.nnotify), (int)(st.nintr - st0.nintr),
+         (int)st.maxinflight);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles, i, n, fd;
+  char path[] = "iob00";
+  char *cold = argc > 2 ? argv[2] : "usertests";
+  uint64 t0;
+
+  nfiles = argc > 1 ? atoi(argv[1]) : NFILES;
+  if(nfiles <= 0 || nfiles > 100){
+    fprintf(2, "usage: iobench [nfiles [file]]\n");
+    exit(1);
+  }
+  memset(buf, 'i', sizeof(buf));
+
+  flush();  // leave nothing from before to the first phase
+
+  begin();
+  t0 = nanotime();
+  for(i = 0; i < nfiles; i++){
+    path[3] = '0' + i / 10;
+    path[4] = '0' + i % 10;
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      fprintf(2, "iobench: create %s failed\n", path);
+      exit(1);
+    }
+    write(fd, buf, sizeof(buf));
+    close(fd);
+  }
+  for(i = 0; i < nfiles; i++){
+    path[3] = '0' + i / 10;
+    path[4] = '0' + i % 10;
+    unlink(path);
+  }
+  flush();
+  report("small files (create, write, unlink)", nfiles, t0);
+
+  begin();
+  t0 = nanotime();
+  if((fd = open("iobig", O_CREATE | O_RDWR)) < 0){
+    fprintf(2, "iobench: create iobig failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NBIG; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "iobench: write failed\n");
+      exit(1);
+    }
+  if(fsync(fd) < 0){
+    fprintf(2, "iobench: fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+  report("large file write (1 KB writes)", NBIG, t0);
+  unlink("iobig");
+  flush();
+
+  begin();
+  t0 = nanotime();
+  if((fd = open(cold, O_RDONLY)) < 0){
+    fprintf(2, "iobench: cannot open %s\n", cold);
+    exit(1);
+  }
+  for(i = 0; (n = read(fd, buf, sizeof(buf))) > 0; i++)
+    ;
+  close(fd);
+  if(i == 0){
+    fprintf(2, "iobench: %s is empty\n", cold);
+    exit(1);
+  }
+  report("large file read (1 KB reads)", i, t0);
+  printf("  of %s, %d blocks\n", cold, i);
+  exit(0);
+}
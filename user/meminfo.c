@@ -0,0 +1,33 @@
+// Print physical memory statistics, including the number of
+// free blocks of each buddy order, to watch fragmentation.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  int k;
+
+  if(memstat(&st) < 0){
+    fprintf(2, "meminfo: memstat failed\n");
+    exit(1);
+  }
+  printf("free pages\t%d (%d on per-cpu lists)\n", (int)st.nfree, (int)st.ncached);
+  printf("allocated\t%d\n", (int)st.nalloc);
+  printf("slab pages\t%d\n", (int)st.nslab);
+  printf("text pages\t%d\n", (int)st.ntext);
+  printf("freed\t\t%d\n", (int)st.nfreed);
+  printf("refills/spills/steals\t%d/%d/%d\n",
+         (int)st.nrefill, (int)st.nspill, (int)st.nsteal);
+  printf("lock contended/acquires\t%d/%d\n",
+         (int)st.lock_contended, (int)st.lock_acquires);
+  printf("order\tpages\tfree blocks\n");
+  for(k = 0; k <= MAXORDER; k++)
+    printf("%d\t%d\t%d\n", k, 1 << k, (int)st.nfree_order[k]);
+  exit(0);
+}
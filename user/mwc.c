@@ -0,0 +1,113 @@
+// wc over mmap().
+// Counts lines, words and characters of each file twice, once
+// with read() into a buffer as wc does, and once by scanning
+// the file mmap()ed MAP_PRIVATE, and prints the time each
+// took. The counts must agree. A first, untimed read() pass
+// brings the file into the buffer cache, so that neither
+// timed pass waits for the disk.
+//
+// mmap() does not save a copy here: each page is copied out
+// of the buffer cache by the fault that maps it, so the
+// comparison is of read() calls against page faults.
+// Usage: mwc file...
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[512];
+
+struct counts {
+  int l, w, c;
+};
+
+void
+count(char *p, int n, struct counts *ct, int *inword)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    ct->c++;
+    if(p[i] == '\n')
+      ct->l++;
+    if(strchr(" \r\t\n\v", p[i]))
+      *inword = 0;
+    else if(!*inword){
+      ct->w++;
+      *inword = 1;
+    }
+  }
+}
+
+// Count the file at path with read(). Returns -1 if it
+// cannot be opened.
+int
+readcount(char *path, struct counts *ct)
+{
+  int fd, n, inword = 0;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  memset(ct, 0, sizeof(*ct));
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    count(buf, n, ct, &inword);
+  close(fd);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct counts r, m;
+  struct stat st;
+  uint64 t0, t1, t2;
+  int fd, i, inword;
+  char *p;
+
+  if(argc <= 1){
+    fprintf(2, "usage: mwc file...\n");
+    exit(1);
+  }
+  for(i = 1; i < argc; i++){
+    if((fd = open(argv[i], O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+      fprintf(2, "mwc: cannot open %s\n", argv[i]);
+      exit(1);
+    }
+    close(fd);
+    if(st.size == 0)
+      continue;
+
+    readcount(argv[i], &r);  // warm the buffer cache
+    t0 = nanotime();
+    if(readcount(argv[i], &r) < 0){
+      fprintf(2, "mwc: cannot open %s\n", argv[i]);
+      exit(1);
+    }
+    t1 = nanotime();
+
+    memset(&m, 0, sizeof(m));
+    inword = 0;
+    if((fd = open(argv[i], O_RDONLY)) < 0){
+      fprintf(2, "mwc: cannot open %s\n", argv[i]);
+      exit(1);
+    }
+    p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == (char*)-1){
+      fprintf(2, "mwc: mmap %s failed\n", argv[i]);
+      exit(1);
+    }
+    count(p, st.size, &m, &inword);
+    munmap(p, st.size);
+    t2 = nanotime();
+
+    printf("%d %d %d %s: read %d us, mmap %d us\n", m.l, m.w, m.c, argv[i],
+           (int)((t1 - t0) / 1000), (int)((t2 - t1) / 1000));
+    if(r.l != m.l || r.w != m.w || r.c != m.c){
+      fprintf(2, "mwc: counts differ: read gave %d %d %d\n", r.l, r.w, r.c);
+      exit(1);
+    }
+  }
+  exit(0);
+}
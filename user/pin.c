@@ -0,0 +1,53 @@
+// Pin a process to one cpu.
+// Usage: pin cpu pid
+//        pin cpu command args...
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+void
+usage(void)
+{
+  fprintf(2, "Usage: pin cpu pid | pin cpu command args...\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int cpu, pid;
+
+  if(argc < 3 || argv[1][0] < '0' || argv[1][0] > '9')
+    usage();
+  cpu = atoi(argv[1]);
+  if(cpu >= NCPU)
+    usage();
+
+  if(argv[2][0] >= '0' && argv[2][0] <= '9'){
+    pid = atoi(argv[2]);
+    if(sched_setaffinity(pid, 1ULL << cpu) < 0){
+      fprintf(2, "pin: cannot pin %d to cpu %d\n", pid, cpu);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pin: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(sched_setaffinity(getpid(), 1ULL << cpu) < 0){
+      fprintf(2, "pin: cannot pin to cpu %d\n", cpu);
+      exit(1);
+    }
+    exec(argv[2], argv + 2);
+    fprintf(2, "pin: exec %s failed\n", argv[2]);
+    exit(1);
+  }
+  wait(0);
+  exit(0);
+}
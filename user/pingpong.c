@@ -0,0 +1,69 @@
+// Pipe ping-pong benchmark.
+// A parent and a child bounce one byte back and forth over
+// two pipes for NTICKS ticks. Every round trip is two pipe
+// writes, two sleeps and two wakeups, so the rate mostly
+// measures sleep()/wakeup() and the context switch.
+// Usage: pingpong [nticks]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NTICKS 50
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  int pid, nticks, n = 0;
+  char c = 'x';
+  uint start, end;
+  uint64 t0, t1;
+
+  nticks = argc > 1 ? atoi(argv[1]) : NTICKS;
+  if(nticks <= 0){
+    fprintf(2, "usage: pingpong [nticks]\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "pingpong: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pingpong: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  // start on a tick boundary so short runs are not skewed.
+  start = uptime();
+  while(uptime() == start)
+    ;
+  start = uptime();
+  end = start + nticks;
+  t0 = nanotime();
+  while(uptime() < end){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1)
+      break;
+    n++;
+  }
+  t1 = nanotime();
+  end = uptime();
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+
+  printf("%d round trips in %d ticks: %d per second\n",
+         n, end - start, (int)(n * 1000000000ULL / (t1 - t0)));
+  exit(0);
+}
@@ -0,0 +1,47 @@
+// Sequential read benchmark.
+// Reads a file from start to end in 512-byte pieces, as cat
+// does, and reports the throughput. Blocks already in the
+// buffer cache make it look far better than the disk is, so
+// use a file that hasn't been read since boot; the default
+// is the largest program on the file system.
+//
+// For the throughput without readahead, run it again on a
+// kernel built with make qemu NREADAHEAD=0. It prints the
+// readahead window it was built with, to tell the runs apart.
+// Usage: readbench [file]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[512];
+
+int
+main(int argc, char *argv[])
+{
+  char *path = argc > 1 ? argv[1] : "usertests";
+  int fd, n;
+  uint64 t0, dt, total = 0;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "readbench: cannot open %s\n", path);
+    exit(1);
+  }
+  t0 = nanotime();
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    total += n;
+  dt = nanotime() - t0;
+  close(fd);
+  if(n < 0){
+    fprintf(2, "readbench: read error\n");
+    exit(1);
+  }
+  if(dt == 0)
+    dt = 1;
+  printf("%s: %d KB in %d ms, %d KB/s, readahead up to %d blocks\n", path,
+         (int)(total / 1024), (int)(dt / 1000000),
+         (int)(total * 1000000000ULL / 1024 / dt), NREADAHEAD);
+  exit(0);
+}
@@ -0,0 +1,63 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+char *names[NSCHED] = {
+[SCHED_RR]    "rr",
+[SCHED_FCFS]  "fcfs",
+[SCHED_PBS]   "pbs",
+[SCHED_MLFQ]  "mlfq",
+[SCHED_CFS]   "cfs",
+};
+
+void
+usage(void)
+{
+  fprintf(2, "Usage: schedpolicy rr|fcfs|pbs|mlfq|cfs [pid | command args...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int policy, pid, old;
+
+  if(argc < 2)
+    usage();
+  for(policy = 0; policy < NSCHED; policy++)
+    if(strcmp(argv[1], names[policy]) == 0)
+      break;
+  if(policy == NSCHED)
+    usage();
+
+  // schedpolicy mlfq: switch the whole system.
+  // schedpolicy mlfq 7: switch process 7 (and its future children).
+  if(argc == 2 || (argv[2][0] >= '0' && argv[2][0] <= '9')){
+    pid = argc == 2 ? 0 : atoi(argv[2]);
+    if((old = sched_setpolicy(pid, policy)) < 0){
+      fprintf(2, "schedpolicy: cannot set policy of %d\n", pid);
+      exit(1);
+    }
+    printf("%s -> %s\n", names[old], names[policy]);
+    exit(0);
+  }
+
+  // schedpolicy mlfq command args: run command under the policy.
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "schedpolicy: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(sched_setpolicy(getpid(), policy) < 0){
+      fprintf(2, "schedpolicy: cannot set policy\n");
+      exit(1);
+    }
+    exec(argv[2], argv + 2);
+    fprintf(2, "schedpolicy: exec %s failed\n", argv[2]);
+    exit(1);
+  }
+  wait(0);
+  exit(0);
+}
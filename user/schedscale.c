@@ -0,0 +1,81 @@
+// Context-switch scaling benchmark, a variant of schedulertest.
+// For 1, 2, 4 and 8 pairs of processes, each pair bounces a
+// byte back and forth over two pipes for a fixed number of
+// ticks. Every round trip costs two context switches, so when
+// run with `make qemu CPUS=8` the total should keep growing with
+// the number of pairs unless the harts serialize in scheduler().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NTICKS 20
+#define MAXPAIRS 8
+
+// Run one ping-pong pair for NTICKS ticks.
+// Returns the number of round trips.
+int
+pingpong(void)
+{
+  int ping[2], pong[2];
+  int pid, n = 0;
+  char c = 'x';
+  uint end;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("schedscale: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("schedscale: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  end = uptime() + NTICKS;
+  while(uptime() < end){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1)
+      break;
+    n++;
+  }
+  close(ping[1]);   // partner sees EOF and exits
+  close(pong[0]);
+  wait(0);
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npairs, i, status, total;
+
+  printf("pairs\tround trips\tper tick\n");
+  for(npairs = 1; npairs <= MAXPAIRS; npairs *= 2){
+    for(i = 0; i < npairs; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("schedscale: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        exit(pingpong());
+    }
+    total = 0;
+    for(i = 0; i < npairs; i++){
+      if(wait(&status) >= 0)
+        total += status;
+    }
+    printf("%d\t%d\t\t%d\n", npairs, total, total / NTICKS);
+  }
+  exit(0);
+}
@@ -0,0 +1,50 @@
+// Sleep latency benchmark.
+// For a range of requested durations, calls nanosleep()
+// NITER times and reports the average and worst time
+// actually slept, as measured by nanotime(). For comparison
+// it also times sleep(1), which can only wake on a tick.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NITER 20
+
+uint64 durations[] = { 10000, 100000, 1000000, 10000000 };  // ns
+
+int
+main(int argc, char *argv[])
+{
+  uint64 t0, dt, sum, worst;
+  int i, j;
+
+  printf("request(us)\tavg(us)\tworst(us)\n");
+  for(i = 0; i < sizeof(durations)/sizeof(durations[0]); i++){
+    sum = worst = 0;
+    for(j = 0; j < NITER; j++){
+      t0 = nanotime();
+      if(nanosleep(durations[i]) < 0){
+        printf("sleeplat: nanosleep failed\n");
+        exit(1);
+      }
+      dt = nanotime() - t0;
+      sum += dt;
+      if(dt > worst)
+        worst = dt;
+    }
+    printf("%d\t\t%d\t%d\n", (int)(durations[i] / 1000),
+           (int)(sum / NITER / 1000), (int)(worst / 1000));
+  }
+
+  sum = worst = 0;
+  for(j = 0; j < NITER; j++){
+    t0 = nanotime();
+    sleep(1);
+    dt = nanotime() - t0;
+    sum += dt;
+    if(dt > worst)
+      worst = dt;
+  }
+  printf("sleep(1)\t%d\t%d\n", (int)(sum / NITER / 1000), (int)(worst / 1000));
+  exit(0);
+}
@@ -0,0 +1,51 @@
+// Sparse heap benchmark.
+// Grows the heap by HEAPMB megabytes with sbrk() but touches
+// only one page in every STRIDE, and reports how long the
+// sbrk() and the touches took and how many pages they used.
+// Usage: sparsebench [heap-mb [stride]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define HEAPMB 32
+#define STRIDE 64
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  uint64 before, t0, t1, t2;
+  int i, mb, stride;
+  char *heap;
+
+  mb = argc > 1 ? atoi(argv[1]) : HEAPMB;
+  stride = argc > 2 ? atoi(argv[2]) : STRIDE;
+  if(mb <= 0 || stride <= 0){
+    fprintf(2, "usage: sparsebench [heap-mb [stride]]\n");
+    exit(1);
+  }
+  if(memstat(&st) < 0){
+    fprintf(2, "sparsebench: memstat failed\n");
+    exit(1);
+  }
+  before = st.nfree;
+
+  t0 = nanotime();
+  if((heap = sbrk(mb << 20)) == (char*)-1){
+    fprintf(2, "sparsebench: sbrk failed\n");
+    exit(1);
+  }
+  t1 = nanotime();
+  for(i = 0; i < mb << 20; i += stride * 4096)
+    heap[i] = 1;
+  t2 = nanotime();
+
+  memstat(&st);
+  printf("heap %d MB, touched 1 page in %d: sbrk %d us, touch %d us, %d pages used\n",
+         mb, stride, (int)((t1 - t0) / 1000), (int)((t2 - t1) / 1000),
+         (int)(before - st.nfree));
+  exit(0);
+}
@@ -0,0 +1,62 @@
+// System call benchmark.
+// Times NITER calls of getpid(), the cheapest system call, so
+// the result is mostly the cost of entering and leaving the
+// kernel, including any TLB flushes on the way. Then does the
+// same with a child running alongside, so that the two
+// processes' address spaces share the TLB.
+// Usage: sysbench [niter]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NITER 100000
+
+// Touch one word in each of npages pages, so that getting
+// back the TLB entries for them costs something.
+#define NPAGES 64
+char buf[NPAGES*4096];
+
+static uint64
+run(int niter)
+{
+  uint64 t0;
+  int i, j;
+
+  t0 = nanotime();
+  for(i = 0; i < niter; i++){
+    getpid();
+    for(j = 0; j < NPAGES; j++)
+      buf[j*4096]++;
+  }
+  return nanotime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int niter, pid;
+  uint64 dt;
+
+  niter = argc > 1 ? atoi(argv[1]) : NITER;
+  if(niter <= 0){
+    fprintf(2, "usage: sysbench [niter]\n");
+    exit(1);
+  }
+  memset(buf, 0, sizeof(buf));
+
+  dt = run(niter);
+  printf("getpid: %d ns per call\n", (int)(dt / niter));
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "sysbench: fork failed\n");
+    exit(1);
+  }
+  dt = run(niter);
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  printf("getpid with fork sibling: %d ns per call\n", (int)(dt / niter));
+  exit(0);
+}
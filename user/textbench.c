@@ -0,0 +1,76 @@
+// Shared text benchmark.
+// Starts NCHILD copies of this program, which each wait on a
+// pipe, and reports the average exec time and how many pages
+// each copy costs once they are all running. With the text
+// cache only the first exec reads the program from disk, and
+// the copies share its pages.
+// Usage: textbench [nchild]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define NCHILD 16
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  uint64 before, t0, total = 0;
+  int i, n, pid, p[2], ready[2];
+  char c, *args[] = { argv[0], "-w", 0 };
+
+  if(argc > 1 && strcmp(argv[1], "-w") == 0){
+    // a copy: say we are running, then wait for EOF.
+    write(1, "x", 1);
+    read(0, &c, 1);
+    exit(0);
+  }
+  n = argc > 1 ? atoi(argv[1]) : NCHILD;
+  if(n <= 0 || n > NPROC - 4){
+    fprintf(2, "usage: textbench [nchild]\n");
+    exit(1);
+  }
+  if(pipe(p) < 0 || pipe(ready) < 0 || memstat(&st) < 0){
+    fprintf(2, "textbench: pipe or memstat failed\n");
+    exit(1);
+  }
+  before = st.nfree;
+
+  for(i = 0; i < n; i++){
+    t0 = nanotime();
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "textbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(0);
+      dup(p[0]);
+      close(1);
+      dup(ready[1]);
+      close(p[0]);
+      close(p[1]);
+      close(ready[0]);
+      close(ready[1]);
+      exec(args[0], args);
+      exit(1);
+    }
+    if(read(ready[0], &c, 1) != 1){
+      fprintf(2, "textbench: child failed\n");
+      exit(1);
+    }
+    total += nanotime() - t0;
+  }
+
+  memstat(&st);
+  printf("%d copies: fork+exec %d us each, %d pages each, %d text pages cached\n",
+         n, (int)(total / n / 1000), (int)((before - st.nfree) / n), (int)st.ntext);
+
+  close(p[1]);
+  for(i = 0; i < n; i++)
+    wait(0);
+  exit(0);
+}
@@ -0,0 +1,82 @@
+// TLB benchmark.
+// Maps REGIONMB megabytes of anonymous memory, which the
+// kernel backs with megapages, and reads one word from each
+// page in a scattered order, NROUND times over. Then it forks
+// a child that writes one byte in every megapage, which splits
+// each into 4096-byte pages, and times the same scan in the
+// child. The difference is the cost of the smaller TLB reach
+// and the deeper page-table walks.
+// Usage: tlbbench [region-mb]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define REGIONMB 16
+#define NROUND   20
+#define MEGA     (2*1024*1024)
+
+int sink;
+
+uint64
+scan(char *p, int npage)
+{
+  uint64 t0;
+  int r, i, j;
+
+  t0 = nanotime();
+  for(r = 0; r < NROUND; r++){
+    // 4099 is odd, so this visits every page once.
+    for(i = 0, j = 0; i < npage; i++, j = (j + 4099) % npage)
+      sink += *(int*)(p + j * 4096L);
+  }
+  return (nanotime() - t0) / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, npage, i, pid, fd[2];
+  uint64 t;
+  char *p;
+
+  mb = argc > 1 ? atoi(argv[1]) : REGIONMB;
+  if(mb < 2 || mb % 2 != 0){
+    fprintf(2, "usage: tlbbench [region-mb], an even number\n");
+    exit(1);
+  }
+  npage = mb * 256;
+  p = mmap(0, mb << 20, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1){
+    fprintf(2, "tlbbench: mmap failed\n");
+    exit(1);
+  }
+  for(i = 0; i < npage; i++)
+    p[i * 4096L] = i;
+
+  if(pipe(fd) < 0){
+    fprintf(2, "tlbbench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "tlbbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < mb << 20; i += MEGA)
+      p[i] = 1;
+    t = scan(p, npage);
+    write(fd[1], &t, sizeof(t));
+    exit(0);
+  }
+  wait(0);
+  if(read(fd[0], &t, sizeof(t)) != sizeof(t)){
+    fprintf(2, "tlbbench: child failed\n");
+    exit(1);
+  }
+  printf("%d MB, %d rounds: 4K pages %d us, megapages %d us\n",
+         mb, NROUND, (int)t, (int)scan(p, npage));
+  exit(0);
+}
@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct cpustat;
+struct memstat;
+struct diskstat;
 
 // system calls
 int fork(void);
@@ -26,6 +29,18 @@ int sleep(int);
 int uptime(void);
 int trace(int);
 int set_priority(int, int);
+int sched_setpolicy(int, int);
+int setnice(int, int);
+int cpustat(struct cpustat*, int);
+uint64 nanotime(void);
+int nanosleep(uint64);
+int sched_setaffinity(int, uint64);
+uint64 sched_getaffinity(int);
+int memstat(struct memstat*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int diskstat(struct diskstat*);
+int fsync(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
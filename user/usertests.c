@@ -107,6 +107,223 @@ copyout(char *s)
   }
 }
 
+// read() from README into p, which must fail.
+static void
+readro(char *s, char *p)
+{
+  int fd, n;
+
+  fd = open("README", 0);
+  if(fd < 0){
+    printf("%s: open(README) failed\n", s);
+    exit(1);
+  }
+  n = read(fd, p, 10);
+  close(fd);
+  if(n != -1){
+    printf("%s: read into PROT_READ mapping returned %d, not -1\n", s, n);
+    exit(1);
+  }
+}
+
+// the kernel must not write to a read-only mapping on the
+// process's behalf, nor, after fork, to a page the parent and
+// child share.
+void
+copyoutro(char *s)
+{
+  char *p;
+  int fd, pid, xstatus;
+
+  fd = open("README", 0);
+  if(fd < 0){
+    printf("%s: open(README) failed\n", s);
+    exit(1);
+  }
+  p = mmap(0, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  readro(s, p);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    readro(s, p);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  munmap(p, 4096);
+}
+
+// stores to a MAP_SHARED file mapping, and read()s into it,
+// must reach the file once it is unmapped.
+void
+mmapshared(char *s)
+{
+  char *p;
+  int fd, fds[2], i;
+
+  unlink("mmapf");
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create mmapf failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', PGSIZE);
+  for(i = 0; i < 2; i++){
+    if(write(fd, buf, PGSIZE) != PGSIZE){
+      printf("%s: write mmapf failed\n", s);
+      exit(1);
+    }
+  }
+  p = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a' || p[2*PGSIZE-1] != 'a'){
+    printf("%s: mapping does not hold the file\n", s);
+    exit(1);
+  }
+
+  // a store from user space to the first page, and a pipe
+  // read, which the kernel copies out, into the second.
+  p[10] = 'b';
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "ccc", 3);
+  if(read(fds[0], p + PGSIZE + 10, 3) != 3){
+    printf("%s: read into mapping failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(munmap(p, 2*PGSIZE) != 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  fd = open("mmapf", O_RDONLY);
+  if(fd < 0 || read(fd, buf, 2*PGSIZE) != 2*PGSIZE){
+    printf("%s: read mmapf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapf");
+  if(buf[9] != 'a' || buf[10] != 'b' || buf[11] != 'a'){
+    printf("%s: store through mapping was lost\n", s);
+    exit(1);
+  }
+  if(buf[PGSIZE+10] != 'c' || buf[PGSIZE+12] != 'c' || buf[PGSIZE+13] != 'a'){
+    printf("%s: read() into mapping was lost\n", s);
+    exit(1);
+  }
+}
+
+// after fork, a MAP_PRIVATE page belongs to each process on
+// its own, and a MAP_SHARED one to both.
+void
+mmapfork(char *s)
+{
+  char *priv, *shared;
+  int pid, xstatus;
+
+  priv = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  shared = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(priv == (char*)-1 || shared == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  priv[0] = 'p';
+  shared[0] = 's';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(priv[0] != 'p' || shared[0] != 's'){
+      printf("%s: child does not see the parent's pages\n", s);
+      exit(1);
+    }
+    priv[0] = 'c';
+    shared[0] = 'c';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(priv[0] != 'p'){
+    printf("%s: child's store reached the parent's private page\n", s);
+    exit(1);
+  }
+  if(shared[0] != 'c'){
+    printf("%s: child's store did not reach the shared page\n", s);
+    exit(1);
+  }
+  munmap(priv, PGSIZE);
+  munmap(shared, PGSIZE);
+}
+
+// munmap() of the first and last pages of a mapping leaves
+// the middle in place, and the removed pages unmapped.
+void
+mmapunmap(char *s)
+{
+  char *p;
+  int i, pid, xstatus;
+
+  p = mmap(0, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++)
+    p[i*PGSIZE] = 'a' + i;
+  if(munmap(p + PGSIZE, PGSIZE) != -1){
+    printf("%s: munmap of a hole succeeded\n", s);
+    exit(1);
+  }
+  if(munmap(p, PGSIZE) != 0 || munmap(p + 3*PGSIZE, PGSIZE) != 0){
+    printf("%s: munmap of prefix or suffix failed\n", s);
+    exit(1);
+  }
+  if(p[PGSIZE] != 'b' || p[2*PGSIZE] != 'c'){
+    printf("%s: middle of mapping changed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i += 3){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      printf("%s: oops could read %x = %x\n", s, p + i*PGSIZE, p[i*PGSIZE]);
+      exit(1);
+    }
+    wait(&xstatus);
+    if(xstatus != -1)  // did kernel kill child?
+      exit(1);
+  }
+  if(munmap(p + PGSIZE, 2*PGSIZE) != 0){
+    printf("%s: munmap of the rest failed\n", s);
+    exit(1);
+  }
+}
+
 // what if you pass ridiculous string pointers to system calls?
 void
 copyinstr1(char *s)
@@ -724,6 +941,71 @@ exectest(char *s)
 
 }
 
+// Run tbusy, a copy of echo, in a child, and return its exit
+// status: 2 if exec() failed.
+static int
+runtbusy(char *s)
+{
+  int pid, xstatus;
+  char *argv[] = { "tbusy", 0 };
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    exec("tbusy", argv);
+    exit(2);
+  }
+  wait(&xstatus);
+  return xstatus;
+}
+
+// a program may not be written while it runs, nor run while
+// it is open for writing.
+void
+textbusy(char *s)
+{
+  int fd, out, n;
+
+  // usertests itself is running.
+  if((fd = open("usertests", O_RDWR)) >= 0){
+    printf("%s: opened the running usertests for writing\n", s);
+    exit(1);
+  }
+  if((fd = open("usertests", O_RDONLY|O_TRUNC)) >= 0){
+    printf("%s: truncated the running usertests\n", s);
+    exit(1);
+  }
+
+  fd = open("echo", O_RDONLY);
+  out = open("tbusy", O_CREATE|O_RDWR);
+  if(fd < 0 || out < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(write(out, buf, n) != n){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  if(runtbusy(s) != 2){
+    printf("%s: ran tbusy while it was open for writing\n", s);
+    exit(1);
+  }
+  close(out);
+  if(runtbusy(s) != 0){
+    printf("%s: could not run tbusy once closed\n", s);
+    exit(1);
+  }
+  unlink("tbusy");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -2823,6 +3105,10 @@ main(int argc, char *argv[])
     {execout, "execout"},
     {copyin, "copyin"},
     {copyout, "copyout"},
+    {copyoutro, "copyoutro"},
+    {mmapshared, "mmapshared"},
+    {mmapfork, "mmapfork"},
+    {mmapunmap, "mmapunmap"},
     {copyinstr1, "copyinstr1"},
     {copyinstr2, "copyinstr2"},
     {copyinstr3, "copyinstr3"},
@@ -2850,6 +3136,7 @@ main(int argc, char *argv[])
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
+    {textbusy, "textbusy"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
@@ -38,4 +38,16 @@ entry("sleep");
 entry("uptime");
 entry("trace");
 entry("set_priority");
-entry("waitx")
\ No newline at end of file
+entry("waitx");
+entry("sched_setpolicy");
+entry("setnice");
+entry("cpustat");
+entry("nanotime");
+entry("nanosleep");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("memstat");
+entry("mmap");
+entry("munmap");
+entry("diskstat");
+entry("fsync");
\ No newline at end of file